@@ -0,0 +1,137 @@
+// Compares drawing CLX sprites directly with drawing their compiled form.
+//
+// Usage: clx_compiled_benchmark [file.clx]
+//
+// Without a file, uses generated sprites with a mix of transparent, solid and noisy runs.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+#include <algorithm>
+#include <random>
+#include <span>
+#include <vector>
+
+#include <clx2pixels.hpp>
+#include <clx_compiled.hpp>
+#include <clx_view.hpp>
+#include <pixels2clx.hpp>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int NumRuns = 7;
+
+std::vector<uint8_t> GenerateClx()
+{
+	constexpr unsigned Width = 96;
+	constexpr unsigned Height = 128;
+	constexpr unsigned NumFrames = 64;
+	std::mt19937 rng(1);
+	std::vector<uint8_t> pixels(Width * Height * NumFrames, 0);
+	for (unsigned frame = 0; frame < NumFrames; ++frame) {
+		for (unsigned y = 0; y < Height; ++y) {
+			for (unsigned x = 0; x < Width; ++x) {
+				const int dx = static_cast<int>(x) - Width / 2;
+				const int dy = static_cast<int>(y) - Height / 2;
+				if (dx * dx * 2 + dy * dy > 3000 + static_cast<int>(rng() % 400))
+					continue;
+				// Solid bands alternating with noise.
+				pixels[(frame * Height + y) * Width + x] = (y / 8) % 2 == 0 ? 10 + y / 8 : 1 + rng() % 200;
+			}
+		}
+	}
+	std::vector<uint8_t> clx;
+	dvl_gfx::Pixels2Clx(pixels.data(), Width, Width, Height, NumFrames, 0, clx);
+	return clx;
+}
+
+/**
+ * @return The fastest time of `NumRuns` runs of `fn`, in nanoseconds.
+ */
+template <typename Fn>
+double Measure(Fn &&fn)
+{
+	double best = 1e300;
+	for (int run = 0; run < NumRuns; ++run) {
+		const Clock::time_point start = Clock::now();
+		fn();
+		best = std::min(best, std::chrono::duration<double, std::nano>(Clock::now() - start).count());
+	}
+	return best;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+	std::vector<uint8_t> generated;
+	dvl_gfx::ClxView view;
+	if (argc > 1) {
+		if (std::optional<dvl_gfx::IoError> error = view.open(argv[1]); error.has_value()) {
+			std::fprintf(stderr, "%s\n", error->message.c_str());
+			return 1;
+		}
+	} else {
+		generated = GenerateClx();
+		if (std::optional<dvl_gfx::IoError> error = view.open(std::span<const uint8_t>(generated)); error.has_value()) {
+			std::fprintf(stderr, "%s\n", error->message.c_str());
+			return 1;
+		}
+	}
+
+	std::vector<std::span<const uint8_t>> sprites;
+	unsigned maxWidth = 0;
+	unsigned maxHeight = 0;
+	for (size_t i = 0; i < view.numLists(); ++i) {
+		const dvl_gfx::ClxListView list = view.list(i);
+		for (size_t j = 0; j < list.numSprites(); ++j) {
+			const dvl_gfx::ClxSpriteView sprite = list.sprite(j);
+			sprites.push_back(sprite.data());
+			maxWidth = std::max<unsigned>(maxWidth, sprite.width());
+			maxHeight = std::max<unsigned>(maxHeight, sprite.height());
+		}
+	}
+	if (sprites.empty()) {
+		std::fprintf(stderr, "No sprites\n");
+		return 1;
+	}
+
+	std::vector<dvl_gfx::CompiledClxSprite> compiled;
+	const double compileNs = Measure([&]() {
+		compiled.clear();
+		for (const std::span<const uint8_t> sprite : sprites)
+			compiled.push_back(dvl_gfx::CompileClxSprite(sprite));
+	});
+
+	// Draw every sprite many times over, like a renderer would.
+	constexpr int NumRepeats = 50;
+	std::vector<uint8_t> direct(static_cast<size_t>(maxWidth) * maxHeight, 0);
+	std::vector<uint8_t> fromCompiled = direct;
+	const double directNs = Measure([&]() {
+		for (int i = 0; i < NumRepeats; ++i) {
+			for (const std::span<const uint8_t> sprite : sprites)
+				dvl_gfx::ClxSprite2Pixels(sprite, direct.data(), maxWidth);
+		}
+	});
+	const double compiledNs = Measure([&]() {
+		for (int i = 0; i < NumRepeats; ++i) {
+			for (const dvl_gfx::CompiledClxSprite &sprite : compiled)
+				dvl_gfx::CompiledClxSprite2Pixels(sprite, fromCompiled.data(), maxWidth);
+		}
+	});
+
+	const double numBlits = static_cast<double>(sprites.size()) * NumRepeats;
+	std::printf("sprites:          %zu\n", sprites.size());
+	std::printf("compile:          %.1f ns/sprite\n", compileNs / sprites.size());
+	std::printf("ClxSprite2Pixels: %.1f ns/sprite\n", directNs / numBlits);
+	std::printf("compiled:         %.1f ns/sprite (%.2fx)\n", compiledNs / numBlits, directNs / compiledNs);
+	if (direct != fromCompiled) {
+		std::fprintf(stderr, "Output mismatch\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "cpu_dispatch.hpp"
+
+#ifdef DVL_GFX_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+namespace dvl_gfx {
+
+DVL_GFX_ALWAYS_INLINE void BlitFillDirect(uint8_t *dst, unsigned length, uint8_t color)
+{
+	std::memset(dst, color, length);
+}
+
+DVL_GFX_ALWAYS_INLINE void BlitPixelsDirect(uint8_t *dst, const uint8_t *src, unsigned length)
+{
+	std::memcpy(dst, src, length);
+}
+
+#ifdef DVL_GFX_X86_DISPATCH
+// The SIMD variants copy and fill with (possibly overlapping) unaligned vector stores,
+// never touching anything outside of [dst, dst + length) and [src, src + length).
+
+/** @brief Fills up to 15 pixels with two overlapping word stores. */
+DVL_GFX_ALWAYS_INLINE void BlitFillShort(uint8_t *dst, unsigned length, uint8_t color)
+{
+	if (length >= 8) {
+		const uint64_t word = color * 0x0101010101010101ULL;
+		std::memcpy(dst, &word, 8);
+		std::memcpy(dst + length - 8, &word, 8);
+	} else if (length >= 4) {
+		const uint32_t word = color * 0x01010101U;
+		std::memcpy(dst, &word, 4);
+		std::memcpy(dst + length - 4, &word, 4);
+	} else {
+		for (unsigned i = 0; i < length; ++i)
+			dst[i] = color;
+	}
+}
+
+/** @brief Copies up to 15 pixels with two overlapping word loads and stores. */
+DVL_GFX_ALWAYS_INLINE void BlitPixelsShort(uint8_t *dst, const uint8_t *src, unsigned length)
+{
+	if (length >= 8) {
+		uint64_t head;
+		uint64_t tail;
+		std::memcpy(&head, src, 8);
+		std::memcpy(&tail, src + length - 8, 8);
+		std::memcpy(dst, &head, 8);
+		std::memcpy(dst + length - 8, &tail, 8);
+	} else if (length >= 4) {
+		uint32_t head;
+		uint32_t tail;
+		std::memcpy(&head, src, 4);
+		std::memcpy(&tail, src + length - 4, 4);
+		std::memcpy(dst, &head, 4);
+		std::memcpy(dst + length - 4, &tail, 4);
+	} else {
+		for (unsigned i = 0; i < length; ++i)
+			dst[i] = src[i];
+	}
+}
+
+DVL_GFX_TARGET_SSE42 inline void BlitFillSse42(uint8_t *dst, unsigned length, uint8_t color)
+{
+	if (length < 16) {
+		BlitFillShort(dst, length, color);
+		return;
+	}
+	const __m128i v = _mm_set1_epi8(static_cast<char>(color));
+	for (unsigned i = 0; i + 16 < length; i += 16)
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), v);
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + length - 16), v);
+}
+
+DVL_GFX_TARGET_SSE42 inline void BlitPixelsSse42(uint8_t *dst, const uint8_t *src, unsigned length)
+{
+	if (length < 16) {
+		BlitPixelsShort(dst, src, length);
+		return;
+	}
+	for (unsigned i = 0; i + 16 < length; i += 16)
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)));
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + length - 16),
+	    _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + length - 16)));
+}
+
+DVL_GFX_TARGET_AVX2 inline void BlitFillAvx2(uint8_t *dst, unsigned length, uint8_t color)
+{
+	if (length < 32) {
+		BlitFillSse42(dst, length, color);
+		return;
+	}
+	const __m256i v = _mm256_set1_epi8(static_cast<char>(color));
+	for (unsigned i = 0; i + 32 < length; i += 32)
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), v);
+	_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + length - 32), v);
+}
+
+DVL_GFX_TARGET_AVX2 inline void BlitPixelsAvx2(uint8_t *dst, const uint8_t *src, unsigned length)
+{
+	if (length < 32) {
+		BlitPixelsSse42(dst, src, length);
+		return;
+	}
+	for (unsigned i = 0; i + 32 < length; i += 32)
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i)));
+	_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + length - 32),
+	    _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + length - 32)));
+}
+
+// AVX-512 masked stores write exactly `length` pixels and masked loads never fault
+// on the masked-out bytes, so a single instruction handles any length up to 64.
+
+DVL_GFX_TARGET_AVX512 inline void BlitFillAvx512(uint8_t *dst, unsigned length, uint8_t color)
+{
+	const __m512i v = _mm512_set1_epi8(static_cast<char>(color));
+	for (; length > 64; length -= 64, dst += 64)
+		_mm512_storeu_si512(dst, v);
+	_mm512_mask_storeu_epi8(dst, _bzhi_u64(~uint64_t { 0 }, length), v);
+}
+
+DVL_GFX_TARGET_AVX512 inline void BlitPixelsAvx512(uint8_t *dst, const uint8_t *src, unsigned length)
+{
+	for (; length > 64; length -= 64, dst += 64, src += 64)
+		_mm512_storeu_si512(dst, _mm512_loadu_si512(src));
+	const __mmask64 mask = _bzhi_u64(~uint64_t { 0 }, length);
+	_mm512_mask_storeu_epi8(dst, mask, _mm512_maskz_loadu_epi8(mask, src));
+}
+#endif
+
+template <CpuIsa Isa>
+DVL_GFX_ALWAYS_INLINE void BlitFill(uint8_t *dst, unsigned length, uint8_t color)
+{
+#ifdef DVL_GFX_X86_DISPATCH
+	if constexpr (Isa == CpuIsa::Avx512) {
+		BlitFillAvx512(dst, length, color);
+		return;
+	} else if constexpr (Isa == CpuIsa::Avx2) {
+		BlitFillAvx2(dst, length, color);
+		return;
+	} else if constexpr (Isa == CpuIsa::Sse42) {
+		BlitFillSse42(dst, length, color);
+		return;
+	}
+#endif
+	BlitFillDirect(dst, length, color);
+}
+
+template <CpuIsa Isa>
+DVL_GFX_ALWAYS_INLINE void BlitPixels(uint8_t *dst, const uint8_t *src, unsigned length)
+{
+#ifdef DVL_GFX_X86_DISPATCH
+	if constexpr (Isa == CpuIsa::Avx512) {
+		BlitPixelsAvx512(dst, src, length);
+		return;
+	} else if constexpr (Isa == CpuIsa::Avx2) {
+		BlitPixelsAvx2(dst, src, length);
+		return;
+	} else if constexpr (Isa == CpuIsa::Sse42) {
+		BlitPixelsSse42(dst, src, length);
+		return;
+	}
+#endif
+	BlitPixelsDirect(dst, src, length);
+}
+
+} // namespace dvl_gfx
@@ -2,16 +2,20 @@
 
 #include <cassert>
 #include <cerrno>
+#include <cstddef>
 #include <cstring>
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include <dvl_gfx_common.hpp>
 #include <dvl_gfx_endian.hpp>
 
 #include "clx_encode.hpp"
+#include "clx_encode_frames.hpp"
 
 namespace dvl_gfx {
 
@@ -28,99 +32,284 @@ constexpr uint8_t GetCelTransparentWidth(uint8_t control)
 	return -static_cast<int8_t>(control);
 }
 
-} // namespace
-
-std::optional<IoError> CelToClx(const uint8_t *data, size_t size,
-    const uint16_t *widths, size_t numWidths, std::vector<uint8_t> &clxData)
+/**
+ * @brief Returns the size of the list of frame group offsets that a CEL file begins with,
+ * or 0 if the file is a single group.
+ *
+ * A CEL file either begins with:
+ * 1. A CEL header.
+ * 2. A list of offsets to frame groups (each group is a CEL file).
+ */
+size_t GetCelGroupsHeaderSize(const uint8_t *data, size_t size)
 {
-	// A CEL file either begins with:
-	// 1. A CEL header.
-	// 2. A list of offsets to frame groups (each group is a CEL file).
-	size_t groupsHeaderSize = 0;
-	uint32_t numGroups = 1;
 	const uint32_t maybeNumFrames = LoadLE32(data);
 
-	// Most files become smaller with CLX. Allocate exactly enough bytes to avoid reallocation.
-	// The only file that becomes larger is data\hf_logo3.CEL, by exactly 4445 bytes.
-	clxData.reserve(size + 4445);
-
 	// If it is a number of frames, then the last frame offset will be equal to the size of the file.
-	if (LoadLE32(&data[maybeNumFrames * 4 + 4]) != size) {
-		// maybeNumFrames is the address of the first group, right after
-		// the list of group offsets.
-		numGroups = maybeNumFrames / 4;
-		groupsHeaderSize = maybeNumFrames;
+	const uint64_t lastFrameOffsetPos = 4 * static_cast<uint64_t>(maybeNumFrames) + 4;
+	if (lastFrameOffsetPos + 4 <= size && LoadLE32(&data[lastFrameOffsetPos]) == size)
+		return 0;
+
+	// maybeNumFrames is the address of the first group, right after
+	// the list of group offsets.
+	return maybeNumFrames;
+}
+
+/**
+ * @brief The command data of a CEL frame, without the frame header.
+ */
+struct CelFrame {
+	const uint8_t *src;
+	const uint8_t *srcEnd;
+};
+
+/**
+ * @param group The CEL header of the group that the frame belongs to.
+ */
+CelFrame GetCelFrame(const uint8_t *group, size_t frame)
+{
+	const uint8_t *src = &group[LoadLE32(&group[4 * (frame + 1)])];
+	const uint8_t *srcEnd = &group[LoadLE32(&group[4 * (frame + 2)])];
+
+	// Skip CEL frame header if there is one.
+	constexpr size_t CelFrameHeaderSize = 10;
+	const bool celFrameHasHeader = srcEnd - src >= static_cast<std::ptrdiff_t>(CelFrameHeaderSize) && LoadLE16(src) == CelFrameHeaderSize;
+	if (celFrameHasHeader)
+		src += CelFrameHeaderSize;
+	return CelFrame { src, srcEnd };
+}
+
+/**
+ * @brief The group after `group`. The groups of a CEL file are stored one after another.
+ */
+const uint8_t *GetNextCelGroup(const uint8_t *group)
+{
+	const uint32_t numFrames = LoadLE32(group);
+	return &group[LoadLE32(&group[4 * (1 + static_cast<size_t>(numFrames))])];
+}
+
+template <typename Out>
+void EncodeCel(const uint8_t *data, size_t size,
+    const uint16_t *widths, size_t numWidths,
+    const ClxEncodeOptions &options, Out &out)
+{
+	const size_t groupsHeaderSize = GetCelGroupsHeaderSize(data, size);
+	const size_t numGroups = groupsHeaderSize == 0 ? 1 : groupsHeaderSize / 4;
+	if (groupsHeaderSize != 0) {
 		data += groupsHeaderSize;
-		clxData.resize(groupsHeaderSize);
+		out.appendZeros(groupsHeaderSize);
 	}
 
 	for (size_t group = 0; group < numGroups; ++group) {
-		uint32_t numFrames;
-		if (numGroups == 1) {
-			numFrames = maybeNumFrames;
-		} else {
-			numFrames = LoadLE32(data);
-			WriteLE32(&clxData[4 * group], clxData.size());
-		}
+		const uint32_t numFrames = LoadLE32(data);
+		if (numGroups != 1)
+			out.writeLE32At(4 * group, out.size());
 
 		// CLX header: frame count, frame offset for each frame, file size
-		const size_t clxDataOffset = clxData.size();
-		clxData.resize(clxData.size() + 4 * (2 + static_cast<size_t>(numFrames)));
-		WriteLE32(&clxData[clxDataOffset], numFrames);
-
-		const uint8_t *srcEnd = &data[LoadLE32(&data[4])];
-		for (size_t frame = 1; frame <= numFrames; ++frame) {
-			const uint8_t *src = srcEnd;
-			srcEnd = &data[LoadLE32(&data[4 * (frame + 1)])];
-			WriteLE32(&clxData[clxDataOffset + 4 * frame], static_cast<uint32_t>(clxData.size() - clxDataOffset));
-
-			// Skip CEL frame header if there is one.
-			constexpr size_t CelFrameHeaderSize = 10;
-			const bool celFrameHasHeader = LoadLE16(src) == CelFrameHeaderSize;
-			if (celFrameHasHeader)
-				src += CelFrameHeaderSize;
-
-			const unsigned frameWidth = numWidths == 1 ? *widths : widths[frame - 1];
-
-			// CLX frame header.
-			const size_t frameHeaderPos = clxData.size();
-			clxData.resize(clxData.size() + ClxFrameHeaderSize);
-			WriteLE16(&clxData[frameHeaderPos], ClxFrameHeaderSize);
-			WriteLE16(&clxData[frameHeaderPos + 2], frameWidth);
-
-			unsigned transparentRunWidth = 0;
-			size_t frameHeight = 0;
-			while (src != srcEnd) {
-				// Process line:
-				for (unsigned remainingCelWidth = frameWidth; remainingCelWidth != 0;) {
-					uint8_t val = *src++;
-					if (IsCelTransparent(val)) {
-						val = GetCelTransparentWidth(val);
-						transparentRunWidth += val;
-					} else {
-						AppendClxTransparentRun(transparentRunWidth, clxData);
-						transparentRunWidth = 0;
-						AppendClxPixelsOrFillRun(src, val, clxData);
-						src += val;
-					}
-					remainingCelWidth -= val;
-				}
-				++frameHeight;
+		const size_t clxDataOffset = out.appendZeros(4 * (2 + static_cast<size_t>(numFrames)));
+		out.writeLE32At(clxDataOffset, numFrames);
+
+		EncodeClxFrames(
+		    numFrames, options.numThreads, out,
+		    [&](size_t frame, auto &frameOut) {
+			    auto [src, srcEnd] = GetCelFrame(data, frame);
+
+			    const unsigned frameWidth = numWidths == 1 ? *widths : widths[frame];
+
+			    // CLX frame header.
+			    const size_t frameHeaderPos = frameOut.appendZeros(ClxFrameHeaderSize);
+			    frameOut.writeLE16At(frameHeaderPos, ClxFrameHeaderSize);
+			    frameOut.writeLE16At(frameHeaderPos + 2, frameWidth);
+
+			    unsigned transparentRunWidth = 0;
+			    size_t frameHeight = 0;
+			    while (src != srcEnd) {
+				    // Process line:
+				    for (unsigned remainingCelWidth = frameWidth; remainingCelWidth != 0;) {
+					    uint8_t val = *src++;
+					    if (IsCelTransparent(val)) {
+						    val = GetCelTransparentWidth(val);
+						    transparentRunWidth += val;
+					    } else {
+						    AppendClxTransparentRun(transparentRunWidth, frameOut);
+						    transparentRunWidth = 0;
+						    AppendClxPixelsOrFillRun(src, val, frameOut, options);
+						    src += val;
+					    }
+					    remainingCelWidth -= val;
+				    }
+				    ++frameHeight;
+			    }
+			    AppendClxTransparentRun(transparentRunWidth, frameOut);
+			    frameOut.writeLE16At(frameHeaderPos + 4, frameHeight);
+			    InsertClxRowSkipTable(frameHeaderPos, frameHeight, options, frameOut);
+		    },
+		    [&](size_t frame, size_t pos) {
+			    out.writeLE32At(clxDataOffset + 4 * (1 + frame), static_cast<uint32_t>(pos - clxDataOffset));
+		    });
+
+		data = GetNextCelGroup(data);
+	}
+}
+
+/**
+ * @brief Counts the lines of a CEL frame, checking that every command lies within
+ * its line and the frame data.
+ */
+std::optional<IoError> CountCelFrameLines(CelFrame frame, unsigned width, unsigned &numLines)
+{
+	numLines = 0;
+	const uint8_t *src = frame.src;
+	while (src != frame.srcEnd) {
+		for (unsigned remainingWidth = width; remainingWidth != 0;) {
+			if (src == frame.srcEnd)
+				return IoError { "CEL frame ends in the middle of a line" };
+			uint8_t val = *src++;
+			if (IsCelTransparent(val)) {
+				val = GetCelTransparentWidth(val);
+			} else {
+				if (val > frame.srcEnd - src)
+					return IoError { "CEL pixel run out of bounds" };
+				src += val;
 			}
-			AppendClxTransparentRun(transparentRunWidth, clxData);
-			WriteLE16(&clxData[frameHeaderPos + 4], frameHeight);
+			if (val > remainingWidth)
+				return IoError { "CEL run crosses the end of a line" };
+			remainingWidth -= val;
 		}
+		++numLines;
+	}
+	return std::nullopt;
+}
+
+/**
+ * @brief Draws the opaque pixels of a CEL frame checked by `CountCelFrameLines`, bottom line first.
+ *
+ * @param dst The first pixel of the bottom line of the frame.
+ */
+void DrawCelFrame(CelFrame frame, unsigned width, uint8_t *dst, unsigned pitch)
+{
+	const uint8_t *src = frame.src;
+	while (src != frame.srcEnd) {
+		for (unsigned x = 0; x != width;) {
+			uint8_t val = *src++;
+			if (IsCelTransparent(val)) {
+				val = GetCelTransparentWidth(val);
+			} else {
+				std::memcpy(&dst[x], src, val);
+				src += val;
+			}
+			x += val;
+		}
+		dst -= pitch;
+	}
+}
+
+} // namespace
+
+std::optional<IoError> MeasureCelToClxSize(const uint8_t *data, size_t size,
+    const uint16_t *widths, size_t numWidths, size_t &clxSize,
+    const ClxEncodeOptions &options)
+{
+	ClxSizeCounter counter;
+	EncodeCel(data, size, widths, numWidths, options, counter);
+	clxSize = counter.size();
+	return std::nullopt;
+}
+
+std::optional<IoError> CelToClx(const uint8_t *data, size_t size,
+    const uint16_t *widths, size_t numWidths, std::vector<uint8_t> &clxData,
+    const ClxEncodeOptions &options)
+{
+	// Most files become smaller with CLX, so the input size is a good initial capacity.
+	clxData.reserve(size);
+	ClxWriter out { clxData };
+	EncodeCel(data, size, widths, numWidths, options, out);
+	return std::nullopt;
+}
+
+std::optional<IoError> CelToPixels(const uint8_t *data, size_t size,
+    const uint16_t *widths, size_t numWidths, uint8_t transparentColor,
+    std::vector<uint8_t> &pixels, Size *outDimensions)
+{
+	if (size < 4)
+		return IoError { "CEL data too small" };
+	if (numWidths == 0)
+		return IoError { "No frame widths given" };
+	const size_t groupsHeaderSize = GetCelGroupsHeaderSize(data, size);
+	if (groupsHeaderSize > size)
+		return IoError { "CEL group offset table out of bounds" };
+	const size_t numGroups = groupsHeaderSize == 0 ? 1 : groupsHeaderSize / 4;
+
+	// Check the offset tables and count the lines of every frame first, to place the frames
+	// like `Clx2Pixels` does: the frames of each group stacked vertically, and the groups horizontally.
+	struct PlacedFrame {
+		CelFrame frame;
+		unsigned width;
+		unsigned height;
+		uint32_t x;
+		uint32_t y;
+	};
+	std::vector<PlacedFrame> frames;
+	Size imageSize { 0, 0 };
+	const uint8_t *const dataEnd = data + size;
+	const uint8_t *group = data + groupsHeaderSize;
+	for (size_t i = 0; i < numGroups; ++i) {
+		const size_t groupBytes = static_cast<size_t>(dataEnd - group);
+		if (groupBytes < 4)
+			return IoError { std::string("CEL group out of bounds: ").append(std::to_string(i)) };
+		const uint32_t numFrames = LoadLE32(group);
+		if (4 * (2 + static_cast<uint64_t>(numFrames)) > groupBytes)
+			return IoError { std::string("CEL frame offset table out of bounds in group ").append(std::to_string(i)) };
+		uint32_t prevOffset = 4 * (2 + numFrames);
+		for (size_t j = 0; j <= numFrames; ++j) {
+			const uint32_t offset = LoadLE32(&group[4 * (j + 1)]);
+			if (offset < prevOffset || offset > groupBytes)
+				return IoError { std::string("CEL frame offset out of bounds: ").append(std::to_string(j)).append(" in group ").append(std::to_string(i)) };
+			prevOffset = offset;
+		}
+
+		Size groupSize { 0, 0 };
+		for (size_t j = 0; j < numFrames; ++j) {
+			if (numWidths != 1 && j >= numWidths)
+				return IoError { std::string("No width given for frame ").append(std::to_string(j)) };
+			const unsigned width = numWidths == 1 ? *widths : widths[j];
+			if (width == 0)
+				return IoError { "Frame width must be positive" };
+			const CelFrame frame = GetCelFrame(group, j);
+			unsigned height;
+			if (std::optional<IoError> error = CountCelFrameLines(frame, width, height); error.has_value()) {
+				error->message.append(": frame ").append(std::to_string(j)).append(" in group ").append(std::to_string(i));
+				return error;
+			}
+			frames.push_back(PlacedFrame { frame, width, height, imageSize.width, groupSize.height });
+			groupSize.width = std::max(groupSize.width, width);
+			groupSize.height += height;
+		}
+		imageSize.width += groupSize.width;
+		imageSize.height = std::max(imageSize.height, groupSize.height);
+		group = GetNextCelGroup(group);
+	}
 
-		WriteLE32(&clxData[clxDataOffset + 4 * (1 + static_cast<size_t>(numFrames))], static_cast<uint32_t>(clxData.size() - clxDataOffset));
-		data = srcEnd;
+	const size_t imageBytes = static_cast<size_t>(imageSize.width) * imageSize.height;
+	if (pixels.size() < imageBytes)
+		pixels.resize(imageBytes);
+	std::fill_n(pixels.begin(), imageBytes, transparentColor);
+	for (const PlacedFrame &frame : frames) {
+		if (frame.height == 0)
+			continue;
+		// CEL lines are stored bottom to top.
+		DrawCelFrame(frame.frame, frame.width,
+		    &pixels[static_cast<size_t>(frame.y + frame.height - 1) * imageSize.width + frame.x], imageSize.width);
 	}
+	if (outDimensions != nullptr)
+		*outDimensions = imageSize;
 	return std::nullopt;
 }
 
 std::optional<IoError> CelToClx(const char *inputPath, const char *outputPath,
     const uint16_t *widths, size_t numWidths,
     uintmax_t *inputFileSize,
-    uintmax_t *outputFileSize)
+    uintmax_t *outputFileSize,
+    const ClxEncodeOptions &options)
 {
 	std::error_code ec;
 	const uintmax_t size = std::filesystem::file_size(inputPath, ec);
@@ -151,7 +340,7 @@ std::optional<IoError> CelToClx(const char *inputPath, const char *outputPath,
 			                 .append(std::strerror(errno)) };
 
 	std::vector<uint8_t> clxData;
-	const std::optional<IoError> err = CelToClx(ownedData.get(), size, widths, numWidths, clxData);
+	const std::optional<IoError> err = CelToClx(ownedData.get(), size, widths, numWidths, clxData, options);
 	if (err.has_value())
 		return err;
 
@@ -22,6 +22,10 @@ Converts CEL sprite(s) to a CLX file.
 Options:
   --output-dir <arg>           Output directory. Default: input file directory.
   --width <arg>[,<arg>...]     CEL sprite frame width(s), comma-separated.
+  --optimize                   Find the smallest possible encoding. Slower.
+  -j, --jobs <arg>             Number of threads to encode on, 0 for one per CPU core. Default: 1.
+  --row-skip-interval <arg>    Write a row-skip table with every <arg>-th line, so that
+                               decoders can start at any line quickly. Default: none.
   --remove                     Remove the input files.
   -q, --quiet                  Do not log anything.
 )";
@@ -30,6 +34,7 @@ struct Options {
 	std::vector<const char *> inputPaths;
 	std::optional<std::string_view> outputDir;
 	std::vector<uint16_t> widths;
+	ClxEncodeOptions encodeOptions;
 	bool remove = false;
 	bool quiet = false;
 };
@@ -63,6 +68,18 @@ tl::expected<Options, ArgumentError> ParseArguments(int argc, char *argv[])
 			if (!value.has_value())
 				return tl::unexpected { std::move(value).error() };
 			options.widths = *std::move(value);
+		} else if (arg == "--optimize") {
+			options.encodeOptions.optimize = true;
+		} else if (arg == "-j" || arg == "--jobs") {
+			tl::expected<unsigned, ArgumentError> value = ParseIntArgument<unsigned>(state);
+			if (!value.has_value())
+				return tl::unexpected { std::move(value).error() };
+			options.encodeOptions.numThreads = *value;
+		} else if (arg == "--row-skip-interval") {
+			tl::expected<unsigned, ArgumentError> value = ParseIntArgument<unsigned>(state);
+			if (!value.has_value())
+				return tl::unexpected { std::move(value).error() };
+			options.encodeOptions.rowSkipInterval = *value;
 		} else if (arg == "--remove") {
 			options.remove = true;
 		} else if (arg == "-q" || arg == "--quiet") {
@@ -99,7 +116,7 @@ std::optional<IoError> Run(const Options &options)
 		}
 		uintmax_t inputFileSize;
 		uintmax_t outputFileSize;
-		if (std::optional<dvl_gfx::IoError> error = CelToClx(inputPath, outputPath.string().c_str(), options.widths, &inputFileSize, &outputFileSize);
+		if (std::optional<dvl_gfx::IoError> error = CelToClx(inputPath, outputPath.string().c_str(), options.widths, &inputFileSize, &outputFileSize, options.encodeOptions);
 		    error.has_value()) {
 			error->message.append(": ").append(inputPath);
 			return error;
@@ -6,12 +6,15 @@
 #include <filesystem>
 #include <fstream>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include <clx_decode.hpp>
 #include <clx_encode.hpp>
 #include <dvl_gfx_endian.hpp>
 
+#include "clx_encode_frames.hpp"
+
 namespace dvl_gfx {
 
 namespace {
@@ -42,7 +45,7 @@ constexpr uint8_t GetCl2OpaqueFillWidth(uint8_t control)
 size_t CountCl2FramePixels(const uint8_t *src, const uint8_t *srcEnd)
 {
 	size_t numPixels = 0;
-	while (src != srcEnd) {
+	while (src < srcEnd) {
 		uint8_t val = *src++;
 		if (IsCl2Opaque(val)) {
 			if (IsCl2OpaqueFill(val)) {
@@ -60,6 +63,11 @@ size_t CountCl2FramePixels(const uint8_t *src, const uint8_t *srcEnd)
 	return numPixels;
 }
 
+/**
+ * @brief The size of the header of a CL2 frame, which `Cl2ToClxNoReencode` turns into a CLX frame header.
+ */
+constexpr size_t Cl2FrameHeaderSize = 10;
+
 struct SkipSize {
 	int_fast16_t wholeLines;
 	int_fast16_t xOffset;
@@ -72,11 +80,10 @@ SkipSize GetSkipSize(int_fast16_t overrun, int_fast16_t srcWidth)
 	return result;
 }
 
-} // namespace
-
-std::optional<IoError> Cl2ToClx(const uint8_t *data, size_t size,
+template <typename Out>
+void EncodeCl2(const uint8_t *data, size_t size,
     const uint16_t *widths, size_t numWidths,
-    std::vector<uint8_t> &clxData)
+    const ClxEncodeOptions &options, Out &out)
 {
 	uint32_t numGroups = 1;
 	const uint32_t maybeNumFrames = LoadLE32(data);
@@ -87,13 +94,9 @@ std::optional<IoError> Cl2ToClx(const uint8_t *data, size_t size,
 		// maybeNumFrames is the address of the first group, right after
 		// the list of group offsets.
 		numGroups = maybeNumFrames / 4;
-		clxData.resize(maybeNumFrames);
+		out.appendZeros(maybeNumFrames);
 	}
 
-	// Transient buffer for a contiguous run of non-transparent pixels.
-	std::vector<uint8_t> pixels;
-	pixels.reserve(4096);
-
 	for (size_t group = 0; group < numGroups; ++group) {
 		uint32_t numFrames;
 		if (numGroups == 1) {
@@ -101,108 +104,170 @@ std::optional<IoError> Cl2ToClx(const uint8_t *data, size_t size,
 		} else {
 			groupBegin = &data[LoadLE32(&data[group * 4])];
 			numFrames = LoadLE32(groupBegin);
-			WriteLE32(&clxData[4 * group], clxData.size());
+			out.writeLE32At(4 * group, out.size());
 		}
 
 		// CLX header: frame count, frame offset for each frame, file size
-		const size_t clxDataOffset = clxData.size();
-		clxData.resize(clxData.size() + 4 * (2 + static_cast<size_t>(numFrames)));
-		WriteLE32(&clxData[clxDataOffset], numFrames);
-
-		const uint8_t *frameEnd = &groupBegin[LoadLE32(&groupBegin[4])];
-		for (size_t frame = 1; frame <= numFrames; ++frame) {
-			WriteLE32(&clxData[clxDataOffset + 4 * frame],
-			    static_cast<uint32_t>(clxData.size() - clxDataOffset));
-
-			const uint8_t *frameBegin = frameEnd;
-			frameEnd = &groupBegin[LoadLE32(&groupBegin[4 * (frame + 1)])];
-
-			const uint16_t frameWidth = numWidths == 1 ? *widths : widths[frame - 1];
+		const size_t clxDataOffset = out.appendZeros(4 * (2 + static_cast<size_t>(numFrames)));
+		out.writeLE32At(clxDataOffset, numFrames);
+
+		EncodeClxFrames(
+		    numFrames, options.numThreads, out,
+		    [&](size_t frame, auto &frameOut) {
+			    const uint8_t *frameBegin = &groupBegin[LoadLE32(&groupBegin[4 * (frame + 1)])];
+			    const uint8_t *frameEnd = &groupBegin[LoadLE32(&groupBegin[4 * (frame + 2)])];
+
+			    const uint16_t frameWidth = numWidths == 1 ? *widths : widths[frame];
+
+			    const size_t frameHeaderPos = frameOut.appendZeros(ClxFrameHeaderSize);
+			    frameOut.writeLE16At(frameHeaderPos, ClxFrameHeaderSize);
+			    frameOut.writeLE16At(frameHeaderPos + 2, frameWidth);
+
+			    // Transient buffer for a contiguous run of non-transparent pixels.
+			    thread_local std::vector<uint8_t> pixels;
+			    pixels.clear();
+
+			    unsigned transparentRunWidth = 0;
+			    int_fast16_t xOffset = 0;
+			    size_t frameHeight = 0;
+			    const uint8_t *src = frameBegin + LoadLE16(frameBegin);
+			    while (src != frameEnd) {
+				    auto remainingWidth = static_cast<int_fast16_t>(frameWidth) - xOffset;
+				    while (remainingWidth > 0) {
+					    const ClxBlitCommand cmd = ClxGetBlitCommand(src);
+					    switch (cmd.type) {
+					    case ClxBlitType::Transparent:
+						    if (!pixels.empty()) {
+							    AppendClxPixelsOrFillRun(pixels.data(), pixels.size(), frameOut, options);
+							    pixels.clear();
+						    }
+
+						    transparentRunWidth += cmd.length;
+						    break;
+					    case ClxBlitType::Fill:
+					    case ClxBlitType::Pixels:
+						    AppendClxTransparentRun(transparentRunWidth, frameOut);
+						    transparentRunWidth = 0;
+
+						    if (cmd.type == ClxBlitType::Fill) {
+							    pixels.insert(pixels.end(), cmd.length, cmd.color);
+						    } else { // ClxBlitType::Pixels
+							    pixels.insert(pixels.end(), src + 1, cmd.srcEnd);
+						    }
+						    break;
+					    }
+					    src = cmd.srcEnd;
+					    remainingWidth -= cmd.length;
+				    }
+
+				    ++frameHeight;
+				    if (remainingWidth < 0) {
+					    const auto skipSize = GetSkipSize(-remainingWidth, static_cast<int_fast16_t>(frameWidth));
+					    xOffset = skipSize.xOffset;
+					    frameHeight += skipSize.wholeLines;
+				    } else {
+					    xOffset = 0;
+				    }
+			    }
+			    if (!pixels.empty()) {
+				    AppendClxPixelsOrFillRun(pixels.data(), pixels.size(), frameOut, options);
+				    pixels.clear();
+			    }
+			    AppendClxTransparentRun(transparentRunWidth, frameOut);
+
+			    frameOut.writeLE16At(frameHeaderPos + 4, frameHeight);
+			    InsertClxRowSkipTable(frameHeaderPos, frameHeight, options, frameOut);
+		    },
+		    [&](size_t frame, size_t pos) {
+			    out.writeLE32At(clxDataOffset + 4 * (1 + frame), static_cast<uint32_t>(pos - clxDataOffset));
+		    });
+	}
+}
 
-			const size_t frameHeaderPos = clxData.size();
-			clxData.resize(clxData.size() + ClxFrameHeaderSize);
-			WriteLE16(&clxData[frameHeaderPos], ClxFrameHeaderSize);
-			WriteLE16(&clxData[frameHeaderPos + 2], frameWidth);
-
-			unsigned transparentRunWidth = 0;
-			int_fast16_t xOffset = 0;
-			size_t frameHeight = 0;
-			const uint8_t *src = frameBegin + LoadLE16(frameBegin);
-			while (src != frameEnd) {
-				auto remainingWidth = static_cast<int_fast16_t>(frameWidth) - xOffset;
-				while (remainingWidth > 0) {
-					const ClxBlitCommand cmd = ClxGetBlitCommand(src);
-					switch (cmd.type) {
-					case ClxBlitType::Transparent:
-						if (!pixels.empty()) {
-							AppendClxPixelsOrFillRun(pixels.data(), pixels.size(), clxData);
-							pixels.clear();
-						}
-
-						transparentRunWidth += cmd.length;
-						break;
-					case ClxBlitType::Fill:
-					case ClxBlitType::Pixels:
-						AppendClxTransparentRun(transparentRunWidth, clxData);
-						transparentRunWidth = 0;
-
-						if (cmd.type == ClxBlitType::Fill) {
-							pixels.insert(pixels.end(), cmd.length, cmd.color);
-						} else { // ClxBlitType::Pixels
-							pixels.insert(pixels.end(), src + 1, cmd.srcEnd);
-						}
-						break;
-					}
-					src = cmd.srcEnd;
-					remainingWidth -= cmd.length;
-				}
-
-				++frameHeight;
-				if (remainingWidth < 0) {
-					const auto skipSize = GetSkipSize(-remainingWidth, static_cast<int_fast16_t>(frameWidth));
-					xOffset = skipSize.xOffset;
-					frameHeight += skipSize.wholeLines;
-				} else {
-					xOffset = 0;
-				}
-			}
-			if (!pixels.empty()) {
-				AppendClxPixelsOrFillRun(pixels.data(), pixels.size(), clxData);
-				pixels.clear();
-			}
-			AppendClxTransparentRun(transparentRunWidth, clxData);
+} // namespace
 
-			WriteLE16(&clxData[frameHeaderPos + 4], frameHeight);
-		}
+std::optional<IoError> MeasureCl2ToClxSize(const uint8_t *data, size_t size,
+    const uint16_t *widths, size_t numWidths, size_t &clxSize,
+    const ClxEncodeOptions &options)
+{
+	ClxSizeCounter counter;
+	EncodeCl2(data, size, widths, numWidths, options, counter);
+	clxSize = counter.size();
+	return std::nullopt;
+}
 
-		WriteLE32(&clxData[clxDataOffset + 4 * (1 + static_cast<size_t>(numFrames))], static_cast<uint32_t>(clxData.size() - clxDataOffset));
-	}
+std::optional<IoError> Cl2ToClx(const uint8_t *data, size_t size,
+    const uint16_t *widths, size_t numWidths,
+    std::vector<uint8_t> &clxData,
+    const ClxEncodeOptions &options)
+{
+	ClxWriter out { clxData };
+	EncodeCl2(data, size, widths, numWidths, options, out);
 	return std::nullopt;
 }
 
 std::optional<IoError> Cl2ToClxNoReencode(uint8_t *data, size_t size,
     const uint16_t *widths, size_t numWidths)
 {
+	if (size < 4)
+		return IoError { "CL2 data too small" };
+	if (numWidths == 0)
+		return IoError { "No frame widths given" };
 	uint32_t numGroups = 1;
 	const uint32_t maybeNumFrames = LoadLE32(data);
 	uint8_t *groupBegin = data;
 
 	// If it is a number of frames, then the last frame offset will be equal to the size of the file.
-	if (LoadLE32(&data[maybeNumFrames * 4 + 4]) != size) {
+	const uint64_t lastFrameOffsetPos = 4 * static_cast<uint64_t>(maybeNumFrames) + 4;
+	if (lastFrameOffsetPos + 4 > size || LoadLE32(&data[lastFrameOffsetPos]) != size) {
 		// maybeNumFrames is the address of the first group, right after
 		// the list of group offsets.
 		numGroups = maybeNumFrames / 4;
+		if (maybeNumFrames > size)
+			return IoError { "CL2 group offset table out of bounds" };
 	}
 
+	// The frames are modified in place, so check all the groups and compute all the new
+	// frame headers before modifying any.
+	struct FrameHeader {
+		uint8_t *begin;
+		uint16_t width;
+		uint16_t height;
+	};
+	std::vector<FrameHeader> frameHeaders;
 	for (size_t group = 0; group < numGroups; ++group) {
 		uint32_t numFrames;
+		size_t groupSize = size;
 		if (numGroups == 1) {
 			numFrames = maybeNumFrames;
 		} else {
-			groupBegin = &data[LoadLE32(&data[group * 4])];
+			const uint32_t groupOffset = LoadLE32(&data[group * 4]);
+			if (groupOffset > size - 4)
+				return IoError { std::string("CL2 group offset out of bounds: ").append(std::to_string(group)) };
+			groupBegin = &data[groupOffset];
+			groupSize = size - groupOffset;
 			numFrames = LoadLE32(groupBegin);
 		}
 
+		if (4 * (2 + static_cast<uint64_t>(numFrames)) > groupSize)
+			return IoError { std::string("CL2 frame offset table out of bounds in group ").append(std::to_string(group)) };
+		if (numWidths != 1 && numFrames > numWidths)
+			return IoError { std::string("Not enough frame widths for group ").append(std::to_string(group)) };
+		for (size_t frame = 0; frame < numFrames; ++frame) {
+			if ((numWidths == 1 ? *widths : widths[frame]) == 0)
+				return IoError { "Frame width must be positive" };
+		}
+		uint64_t prevOffset = 4 * (2 + static_cast<uint64_t>(numFrames));
+		for (size_t frame = 0; frame <= numFrames; ++frame) {
+			const uint32_t offset = LoadLE32(&groupBegin[4 * (frame + 1)]);
+			// Every frame has a 10-byte header, the size of which is its first field.
+			if (offset > groupSize || (frame != 0 && offset < prevOffset + Cl2FrameHeaderSize) || offset < prevOffset)
+				return IoError { std::string("CL2 frame offset out of bounds: ").append(std::to_string(frame)).append(" in group ").append(std::to_string(group)) };
+			if (frame != 0 && LoadLE16(&groupBegin[prevOffset]) > offset - prevOffset)
+				return IoError { std::string("CL2 frame header too large: ").append(std::to_string(frame - 1)).append(" in group ").append(std::to_string(group)) };
+			prevOffset = offset;
+		}
+
 		uint8_t *frameEnd = &groupBegin[LoadLE32(&groupBegin[4])];
 		for (size_t frame = 1; frame <= numFrames; ++frame) {
 			uint8_t *frameBegin = frameEnd;
@@ -212,16 +277,21 @@ std::optional<IoError> Cl2ToClxNoReencode(uint8_t *data, size_t size,
 
 			const uint16_t frameWidth = numWidths == 1 ? *widths : widths[frame - 1];
 			const uint16_t frameHeight = numPixels / frameWidth;
-			WriteLE16(&frameBegin[2], frameWidth);
-			WriteLE16(&frameBegin[4], frameHeight);
-			memset(&frameBegin[6], 0, 4);
+			frameHeaders.push_back(FrameHeader { frameBegin, frameWidth, frameHeight });
 		}
 	}
+
+	for (const FrameHeader &header : frameHeaders) {
+		WriteLE16(&header.begin[2], header.width);
+		WriteLE16(&header.begin[4], header.height);
+		memset(&header.begin[6], 0, 4);
+	}
 	return std::nullopt;
 }
 
 std::optional<IoError> Cl2ToClx(const char *inputPath, const char *outputPath,
-    const uint16_t *widths, size_t numWidths, bool reencode)
+    const uint16_t *widths, size_t numWidths, bool reencode,
+    const ClxEncodeOptions &options)
 {
 	std::error_code ec;
 	const uintmax_t size = std::filesystem::file_size(inputPath, ec);
@@ -250,7 +320,7 @@ std::optional<IoError> Cl2ToClx(const char *inputPath, const char *outputPath,
 
 	if (reencode) {
 		std::vector<uint8_t> out;
-		std::optional<IoError> result = Cl2ToClx(ownedData.get(), size, widths, numWidths, out);
+		std::optional<IoError> result = Cl2ToClx(ownedData.get(), size, widths, numWidths, out, options);
 		if (result.has_value())
 			return result;
 		output.write(reinterpret_cast<const char *>(out.data()), static_cast<std::streamsize>(out.size()));
@@ -270,7 +340,8 @@ std::optional<IoError> Cl2ToClx(const char *inputPath, const char *outputPath,
 
 std::optional<IoError> CombineCl2AsClxSheet(
     const char *const *inputPaths, size_t numFiles, const char *outputPath,
-    const std::vector<uint16_t> &widths, bool reencode)
+    const std::vector<uint16_t> &widths, bool reencode,
+    const ClxEncodeOptions &options)
 {
 	size_t accumulatedSize = ClxSheetHeaderSize(numFiles);
 	std::vector<size_t> offsets;
@@ -308,7 +379,7 @@ std::optional<IoError> CombineCl2AsClxSheet(
 	if (reencode) {
 		std::vector<uint8_t> out;
 		if (std::optional<IoError> error = Cl2ToClx(
-		        ownedData.get(), accumulatedSize, widths.data(), widths.size(), out);
+		        ownedData.get(), accumulatedSize, widths.data(), widths.size(), out, options);
 		    error.has_value()) {
 			return error;
 		}
@@ -28,6 +28,10 @@ Options:
   --width <arg>[,<arg>...]     CL2 sprite frame width(s), comma-separated.
   --combine                    Combine multiple CL2 files into a single CLX sheet.
   --no-reencode                Do not reencode graphics data with the more optimal DevilutionX encoder.
+  --optimize                   Find the smallest possible encoding. Slower.
+  -j, --jobs <arg>             Number of threads to encode on, 0 for one per CPU core. Default: 1.
+  --row-skip-interval <arg>    Write a row-skip table with every <arg>-th line, so that
+                               decoders can start at any line quickly. Default: none.
   --remove                     Remove the input files.
   -q, --quiet                  Do not log anything.
 )";
@@ -37,6 +41,7 @@ struct Options {
 	std::optional<std::string_view> outputDir;
 	std::optional<std::string_view> outputFilename;
 	std::vector<uint16_t> widths;
+	ClxEncodeOptions encodeOptions;
 	bool combine = false;
 	bool remove = false;
 	bool reencode = true;
@@ -81,6 +86,18 @@ tl::expected<Options, ArgumentError> ParseArguments(int argc, char *argv[])
 			options.combine = true;
 		} else if (arg == "--no-reencode") {
 			options.reencode = false;
+		} else if (arg == "--optimize") {
+			options.encodeOptions.optimize = true;
+		} else if (arg == "-j" || arg == "--jobs") {
+			tl::expected<unsigned, ArgumentError> value = ParseIntArgument<unsigned>(state);
+			if (!value.has_value())
+				return tl::unexpected { std::move(value).error() };
+			options.encodeOptions.numThreads = *value;
+		} else if (arg == "--row-skip-interval") {
+			tl::expected<unsigned, ArgumentError> value = ParseIntArgument<unsigned>(state);
+			if (!value.has_value())
+				return tl::unexpected { std::move(value).error() };
+			options.encodeOptions.rowSkipInterval = *value;
 		} else if (arg == "--remove") {
 			options.remove = true;
 		} else if (arg == "-q" || arg == "--quiet") {
@@ -103,6 +120,14 @@ tl::expected<Options, ArgumentError> ParseArguments(int argc, char *argv[])
 		return tl::unexpected { ArgumentError {
 			"--combine", "requires at least 2 input files" } };
 	}
+	if (!options.reencode && options.encodeOptions.optimize) {
+		return tl::unexpected { ArgumentError {
+			"--optimize", "cannot be combined with --no-reencode" } };
+	}
+	if (!options.reencode && options.encodeOptions.rowSkipInterval != 0) {
+		return tl::unexpected { ArgumentError {
+			"--row-skip-interval", "cannot be combined with --no-reencode" } };
+	}
 	if (options.widths.empty()) {
 		return tl::unexpected { ArgumentError { "--width", "is required" } };
 	}
@@ -145,7 +170,7 @@ std::optional<IoError> Run(const Options &options)
 		}
 		std::optional<dvl_gfx::IoError> error = CombineCl2AsClxSheet(
 		    options.inputPaths.data(), options.inputPaths.size(),
-		    outputPath.string().c_str(), options.widths, options.reencode);
+		    outputPath.string().c_str(), options.widths, options.reencode, options.encodeOptions);
 		if (error.has_value())
 			return error;
 		return std::nullopt;
@@ -166,7 +191,7 @@ std::optional<IoError> Run(const Options &options)
 			}
 			if (std::optional<dvl_gfx::IoError> error = Cl2ToClx(
 			        inputPath, outputPath.string().c_str(),
-			        options.widths, options.reencode);
+			        options.widths, options.reencode, options.encodeOptions);
 			    error.has_value()) {
 				error->message.append(": ").append(inputPath);
 				return error;
@@ -0,0 +1,235 @@
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <cl22clx.hpp>
+#include <clx2pixels.hpp>
+#include <clx_validate.hpp>
+#include <dvl_gfx_common.hpp>
+#include <pcx_encode.hpp>
+
+#include "argument_parser.hpp"
+#include "palette_loader.hpp"
+#include "tl/expected.hpp"
+
+namespace dvl_gfx {
+namespace {
+
+constexpr char KHelp[] = R"(Usage: cl22pcx [options] files...
+
+Converts CL2 sprite(s) to PCX directly, without writing a CLX file first.
+The output is the same as that of cl22clx --no-reencode followed by clx2pcx.
+
+Options:
+  --output-dir <arg>           Output directory. Default: input file directory.
+  --width <arg>[,<arg>...]     CL2 sprite frame width(s), comma-separated.
+  --transparent-color <arg>    Transparent color index. Default: 255.
+  --palette <arg>              default, diablo_menu, hellfire_menu, or a path to a .pal file.
+  -j, --jobs <arg>             Number of threads to decode on, 0 for one per CPU core. Default: 1.
+  --scale <arg>                Downscale the sprites by 1, 2, 4 or 8, e.g. for thumbnails. Default: 1.
+  --remove                     Remove the input files.
+  -q, --quiet                  Do not log anything.
+)";
+
+struct Options {
+	std::vector<const char *> inputPaths;
+	std::optional<std::string_view> outputDir;
+	std::vector<uint16_t> widths;
+	uint8_t transparentColor = 255;
+	std::string_view palette = "default";
+	ClxDecodeOptions decodeOptions;
+	bool remove = false;
+	bool quiet = false;
+};
+
+void PrintHelp()
+{
+	std::cerr << KHelp << std::endl;
+}
+
+tl::expected<Options, ArgumentError> ParseArguments(int argc, char *argv[])
+{
+	if (argc == 1) {
+		PrintHelp();
+		std::exit(64);
+	}
+	Options options;
+	ArgumentParserState state { 1, argc, argv };
+	for (; !state.atEnd(); ++state.pos) {
+		const std::string_view arg = state.arg();
+		if (arg == "-h" || arg == "--help") {
+			PrintHelp();
+			std::exit(0);
+		}
+		if (arg == "--output-dir") {
+			tl::expected<std::string_view, ArgumentError> value = ParseArgumentValue(state);
+			if (!value.has_value())
+				return tl::unexpected { std::move(value).error() };
+			options.outputDir = *value;
+		} else if (arg == "--width") {
+			tl::expected<std::vector<uint16_t>, ArgumentError> value = ParseIntListArgument<uint16_t>(state);
+			if (!value.has_value())
+				return tl::unexpected { std::move(value).error() };
+			options.widths = *std::move(value);
+		} else if (arg == "--transparent-color") {
+			tl::expected<uint8_t, ArgumentError> value = ParseIntArgument<uint8_t>(state);
+			if (!value.has_value())
+				return tl::unexpected { std::move(value).error() };
+			options.transparentColor = *value;
+		} else if (arg == "--palette") {
+			tl::expected<std::string_view, ArgumentError> value = ParseArgumentValue(state);
+			if (!value.has_value())
+				return tl::unexpected { std::move(value).error() };
+			options.palette = *value;
+		} else if (arg == "-j" || arg == "--jobs") {
+			tl::expected<unsigned, ArgumentError> value = ParseIntArgument<unsigned>(state);
+			if (!value.has_value())
+				return tl::unexpected { std::move(value).error() };
+			options.decodeOptions.numThreads = *value;
+		} else if (arg == "--scale") {
+			tl::expected<unsigned, ArgumentError> value = ParseIntArgument<unsigned>(state);
+			if (!value.has_value())
+				return tl::unexpected { std::move(value).error() };
+			if (*value != 1 && *value != 2 && *value != 4 && *value != 8)
+				return tl::unexpected { ArgumentError { "--scale", "must be 1, 2, 4 or 8" } };
+			options.decodeOptions.scale = *value;
+		} else if (arg == "--remove") {
+			options.remove = true;
+		} else if (arg == "-q" || arg == "--quiet") {
+			options.quiet = true;
+		} else if (arg.empty() || arg[0] == '-') {
+			return tl::unexpected { ArgumentError { arg, "unknown argument" } };
+		} else {
+			break;
+		}
+	}
+	if (std::optional<ArgumentError> error = ParsePositionalArguments(state, "files...", options.inputPaths);
+	    error.has_value()) {
+		return tl::unexpected { *std::move(error) };
+	}
+	if (options.widths.empty())
+		return tl::unexpected { ArgumentError { "--width", "is required" } };
+	return options;
+}
+
+std::optional<IoError> Run(const Options &options)
+{
+	if (!options.quiet) {
+		std::clog << "file\tCL2\tPCX" << std::endl;
+	}
+
+	std::optional<std::filesystem::path> outputDirFs;
+	if (options.outputDir.has_value())
+		outputDirFs = *options.outputDir;
+
+	std::array<uint8_t, PaletteSize> palette;
+	if (std::optional<IoError> error = LoadPaletteArgument(options.palette, palette); error.has_value()) {
+		return error;
+	}
+
+	std::vector<ClxSpriteProperties> spriteProperties;
+	for (const char *inputPath : options.inputPaths) {
+		std::filesystem::path inputPathFs { inputPath };
+		std::filesystem::path outputPath;
+		if (outputDirFs.has_value()) {
+			outputPath = *outputDirFs / inputPathFs.filename().replace_extension("pcx");
+		} else {
+			outputPath = std::filesystem::path(inputPathFs).replace_extension("pcx");
+		}
+
+		std::error_code ec;
+		const uintmax_t inputFileSize = std::filesystem::file_size(inputPath, ec);
+		if (ec)
+			return IoError { ec.message() };
+
+		std::ifstream input;
+		input.open(inputPath, std::ios::in | std::ios::binary);
+		if (input.fail())
+			return IoError { std::string("Failed to open input file: ")
+				                 .append(std::strerror(errno)) };
+		std::unique_ptr<uint8_t[]> ownedData { new uint8_t[inputFileSize] };
+		input.read(reinterpret_cast<char *>(ownedData.get()), static_cast<std::streamsize>(inputFileSize));
+		if (input.fail()) {
+			return IoError {
+				std::string("Failed to read CL2 data: ").append(std::strerror(errno))
+			};
+		}
+		input.close();
+		// CL2 commands are the same as CLX commands, so only the frame headers need rewriting.
+		if (std::optional<IoError> error = Cl2ToClxNoReencode(
+		        ownedData.get(), inputFileSize, options.widths.data(), options.widths.size());
+		    error.has_value()) {
+			error->message.append(": ").append(inputPath);
+			return error;
+		}
+		std::span<const uint8_t> clxData(ownedData.get(), inputFileSize);
+		if (std::optional<IoError> error = ValidateClx(clxData, &spriteProperties); error.has_value()) {
+			error->message.append(": ").append(inputPath);
+			return error;
+		}
+		ClxDecodeOptions decodeOptions = options.decodeOptions;
+		decodeOptions.validatedSprites = spriteProperties;
+
+		std::ofstream output;
+		output.open(outputPath, std::ios::out | std::ios::binary);
+		if (output.fail())
+			return IoError { std::string("Failed to open output file: ")
+				                 .append(std::strerror(errno)) };
+
+		if (std::optional<IoError> result = PcxEncodeStackedClx(clxData, options.transparentColor, palette, &output, decodeOptions);
+		    result.has_value()) {
+			// The bands are decoded while writing, so do not leave a truncated file behind.
+			output.close();
+			std::filesystem::remove(outputPath, ec);
+			result->message.append(": ").append(inputPath);
+			return result;
+		}
+		output.close();
+		if (output.fail())
+			return IoError { std::string("Failed to write to output file: ")
+				                 .append(std::strerror(errno)) };
+
+		if (options.remove) {
+			std::filesystem::remove(inputPathFs);
+		}
+		if (!options.quiet) {
+			const uintmax_t outputFileSize = std::filesystem::file_size(outputPath, ec);
+			if (ec)
+				return IoError { ec.message() };
+
+			std::clog << inputPathFs.stem().string() << "\t" << inputFileSize << "\t"
+			          << outputFileSize << std::endl;
+		}
+	}
+	return std::nullopt;
+}
+
+} // namespace
+} // namespace dvl_gfx
+
+int main(int argc, char *argv[])
+{
+	tl::expected<dvl_gfx::Options, dvl_gfx::ArgumentError> options = dvl_gfx::ParseArguments(argc, argv);
+	if (!options) {
+		std::cerr << options.error().arg << ": " << options.error().error
+		          << std::endl;
+		return 64;
+	}
+	if (std::optional<dvl_gfx::IoError> error = Run(*options);
+	    error.has_value()) {
+		std::cerr << error->message << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -14,11 +14,12 @@
 #include <vector>
 
 #include <clx2pixels.hpp>
+#include <clx_validate.hpp>
 #include <dvl_gfx_common.hpp>
-#include <dvl_gfx_embedded_palettes.h>
 #include <pcx_encode.hpp>
 
 #include "argument_parser.hpp"
+#include "palette_loader.hpp"
 #include "tl/expected.hpp"
 
 namespace dvl_gfx {
@@ -32,17 +33,30 @@ Options:
   --output-dir <arg>           Output directory. Default: input file directory.
   --transparent-color <arg>    Transparent color index. Default: 255.
   --palette <arg>              default, diablo_menu, hellfire_menu, or a path to a .pal file.
+  -j, --jobs <arg>             Number of threads to decode on, 0 for one per CPU core. Default: 1.
+  --scale <arg>                Downscale the sprites by 1, 2, 4 or 8, e.g. for thumbnails. Default: 1.
+  --layout <arg>               stacked or packed. Default: stacked.
+                               stacked: lists side by side, with the frames of each list stacked vertically.
+                               packed: the frames packed into a compact atlas. The rectangle of
+                               each frame is written to a <name>.atlas.tsv file next to the PCX.
+  --atlas-width <arg>          The width of the packed atlas. Default: roughly square.
   --remove                     Remove the input files.
   -q, --quiet                  Do not log anything.
 )";
 
-constexpr size_t PaletteSize = 768;
+enum class Layout : uint8_t {
+	Stacked,
+	Packed,
+};
 
 struct Options {
 	std::vector<const char *> inputPaths;
 	std::optional<std::string_view> outputDir;
 	uint8_t transparentColor = 255;
 	std::string_view palette = "default";
+	ClxDecodeOptions decodeOptions;
+	Layout layout = Layout::Stacked;
+	std::optional<unsigned> atlasWidth;
 	bool remove = false;
 	bool quiet = false;
 };
@@ -81,6 +95,36 @@ tl::expected<Options, ArgumentError> ParseArguments(int argc, char *argv[])
 			if (!value.has_value())
 				return tl::unexpected { std::move(value).error() };
 			options.palette = *value;
+		} else if (arg == "-j" || arg == "--jobs") {
+			tl::expected<unsigned, ArgumentError> value = ParseIntArgument<unsigned>(state);
+			if (!value.has_value())
+				return tl::unexpected { std::move(value).error() };
+			options.decodeOptions.numThreads = *value;
+		} else if (arg == "--scale") {
+			tl::expected<unsigned, ArgumentError> value = ParseIntArgument<unsigned>(state);
+			if (!value.has_value())
+				return tl::unexpected { std::move(value).error() };
+			if (*value != 1 && *value != 2 && *value != 4 && *value != 8)
+				return tl::unexpected { ArgumentError { "--scale", "must be 1, 2, 4 or 8" } };
+			options.decodeOptions.scale = *value;
+		} else if (arg == "--layout") {
+			tl::expected<std::string_view, ArgumentError> value = ParseArgumentValue(state);
+			if (!value.has_value())
+				return tl::unexpected { std::move(value).error() };
+			if (*value == "stacked") {
+				options.layout = Layout::Stacked;
+			} else if (*value == "packed") {
+				options.layout = Layout::Packed;
+			} else {
+				return tl::unexpected { ArgumentError { "--layout", "must be stacked or packed" } };
+			}
+		} else if (arg == "--atlas-width") {
+			tl::expected<unsigned, ArgumentError> value = ParseIntArgument<unsigned>(state);
+			if (!value.has_value())
+				return tl::unexpected { std::move(value).error() };
+			if (*value == 0)
+				return tl::unexpected { ArgumentError { "--atlas-width", "must be positive" } };
+			options.atlasWidth = *value;
 		} else if (arg == "--remove") {
 			options.remove = true;
 		} else if (arg == "-q" || arg == "--quiet") {
@@ -95,34 +139,33 @@ tl::expected<Options, ArgumentError> ParseArguments(int argc, char *argv[])
 	    error.has_value()) {
 		return tl::unexpected { *std::move(error) };
 	}
+	if (options.atlasWidth.has_value() && options.layout != Layout::Packed)
+		return tl::unexpected { ArgumentError { "--atlas-width", "requires --layout packed" } };
 	return options;
 }
 
-std::optional<IoError> LoadPalette(std::string_view path, std::array<uint8_t, PaletteSize> &palette)
+std::optional<IoError> WriteAtlasSidecar(const std::filesystem::path &path, std::span<const ClxFrameRect> frameRects)
 {
-	std::error_code ec;
-	const uintmax_t size = std::filesystem::file_size(path, ec);
-	if (ec)
-		return IoError { ec.message() };
-	if (size != PaletteSize)
-		return IoError { "Palette file must be exactly 768 bytes." };
-	std::ifstream input;
-	input.open(std::string(path).c_str(), std::ios::in | std::ios::binary);
-	if (input.fail())
-		return IoError { std::string("Failed to open palette file: ")
-			                 .append(std::strerror(errno)) };
-	input.read(reinterpret_cast<char *>(palette.data()), PaletteSize);
-	if (input.fail()) {
-		return IoError {
-			std::string("Failed to read palette file: ").append(std::strerror(errno))
-		};
-	}
-	input.close();
-	if (input.fail()) {
-		return IoError {
-			std::string("Failed to close palette file: ").append(std::strerror(errno))
-		};
+	std::string out = "list\tframe\tx\ty\twidth\theight\n";
+	for (const ClxFrameRect &rect : frameRects) {
+		out.append(std::to_string(rect.list))
+		    .append("\t").append(std::to_string(rect.frame))
+		    .append("\t").append(std::to_string(rect.x))
+		    .append("\t").append(std::to_string(rect.y))
+		    .append("\t").append(std::to_string(rect.width))
+		    .append("\t").append(std::to_string(rect.height))
+		    .append("\n");
 	}
+	std::ofstream output;
+	output.open(path, std::ios::out | std::ios::binary);
+	if (output.fail())
+		return IoError { std::string("Failed to open output file: ")
+			                 .append(std::strerror(errno)) };
+	output.write(out.data(), static_cast<std::streamsize>(out.size()));
+	output.close();
+	if (output.fail())
+		return IoError { std::string("Failed to write to output file: ")
+			                 .append(std::strerror(errno)) };
 	return std::nullopt;
 }
 
@@ -137,19 +180,13 @@ std::optional<IoError> Run(const Options &options)
 		outputDirFs = *options.outputDir;
 
 	std::array<uint8_t, PaletteSize> palette;
-	if (options.palette == "default") {
-		std::memcpy(palette.data(), dvl_gfx_embedded_default_pal_data, dvl_gfx_embedded_default_pal_size);
-	} else if (options.palette == "diablo_menu") {
-		std::memcpy(palette.data(), dvl_gfx_embedded_diablo_menu_pal_data, dvl_gfx_embedded_diablo_menu_pal_size);
-	} else if (options.palette == "hellfire_menu") {
-		std::memcpy(palette.data(), dvl_gfx_embedded_hellfire_menu_pal_data, dvl_gfx_embedded_hellfire_menu_pal_size);
-	} else {
-		if (std::optional<IoError> error = LoadPalette(options.palette, palette); error.has_value()) {
-			return error;
-		}
+	if (std::optional<IoError> error = LoadPaletteArgument(options.palette, palette); error.has_value()) {
+		return error;
 	}
 
 	std::vector<uint8_t> pixels;
+	std::vector<ClxFrameRect> frameRects;
+	std::vector<ClxSpriteProperties> spriteProperties;
 	for (const char *inputPath : options.inputPaths) {
 		std::filesystem::path inputPathFs { inputPath };
 		std::filesystem::path outputPath;
@@ -159,49 +196,69 @@ std::optional<IoError> Run(const Options &options)
 			outputPath = std::filesystem::path(inputPathFs).replace_extension("pcx");
 		}
 
-		Size dimensions;
-		uintmax_t inputFileSize;
-		{
-			std::error_code ec;
-			inputFileSize = std::filesystem::file_size(inputPath, ec);
-			if (ec)
-				return IoError { ec.message() };
+		std::error_code ec;
+		const uintmax_t inputFileSize = std::filesystem::file_size(inputPath, ec);
+		if (ec)
+			return IoError { ec.message() };
 
-			std::ifstream input;
-			input.open(inputPath, std::ios::in | std::ios::binary);
-			if (input.fail())
-				return IoError { std::string("Failed to open input file: ")
-					                 .append(std::strerror(errno)) };
-			std::unique_ptr<uint8_t[]> ownedData { new uint8_t[inputFileSize] };
-			input.read(reinterpret_cast<char *>(ownedData.get()), static_cast<std::streamsize>(inputFileSize));
-			if (input.fail()) {
-				return IoError {
-					std::string("Failed to read CLX data: ").append(std::strerror(errno))
-				};
-			}
-			input.close();
-			std::span<const uint8_t> clxData(ownedData.get(), inputFileSize);
-			if (std::optional<IoError> error = Clx2Pixels(
-			        clxData, options.transparentColor, pixels,
-			        /*pitch=*/std::nullopt, &dimensions);
+		std::ifstream input;
+		input.open(inputPath, std::ios::in | std::ios::binary);
+		if (input.fail())
+			return IoError { std::string("Failed to open input file: ")
+				                 .append(std::strerror(errno)) };
+		std::unique_ptr<uint8_t[]> ownedData { new uint8_t[inputFileSize] };
+		input.read(reinterpret_cast<char *>(ownedData.get()), static_cast<std::streamsize>(inputFileSize));
+		if (input.fail()) {
+			return IoError {
+				std::string("Failed to read CLX data: ").append(std::strerror(errno))
+			};
+		}
+		input.close();
+		std::span<const uint8_t> clxData(ownedData.get(), inputFileSize);
+		if (std::optional<IoError> error = ValidateClx(clxData, &spriteProperties); error.has_value()) {
+			error->message.append(": ").append(inputPath);
+			return error;
+		}
+		ClxDecodeOptions decodeOptions = options.decodeOptions;
+		decodeOptions.validatedSprites = spriteProperties;
+
+		Size dimensions;
+		if (options.layout == Layout::Packed) {
+			if (std::optional<IoError> error = Clx2PixelsPacked(
+			        clxData, options.transparentColor, pixels, frameRects,
+			        &dimensions, decodeOptions, options.atlasWidth);
 			    error.has_value()) {
 				error->message.append(": ").append(inputPath);
 				return error;
 			}
+			if (std::optional<IoError> error = WriteAtlasSidecar(
+			        std::filesystem::path(outputPath).replace_extension("atlas.tsv"), frameRects);
+			    error.has_value()) {
+				return error;
+			}
 		}
 
-		uintmax_t outputFileSize;
 		std::ofstream output;
 		output.open(outputPath, std::ios::out | std::ios::binary);
 		if (output.fail())
 			return IoError { std::string("Failed to open output file: ")
 				                 .append(std::strerror(errno)) };
 
-		std::optional<IoError> result = PcxEncode(
-		    std::span(pixels.data(), dimensions.width * dimensions.height), dimensions,
-		    dimensions.width, std::span(palette.data(), palette.size()), &output);
-		if (result.has_value())
+		std::optional<IoError> result;
+		if (options.layout == Layout::Packed) {
+			result = PcxEncode(
+			    std::span(pixels.data(), dimensions.width * dimensions.height), dimensions,
+			    dimensions.width, std::span(palette.data(), palette.size()), &output);
+		} else {
+			result = PcxEncodeStackedClx(clxData, options.transparentColor, palette, &output, decodeOptions);
+		}
+		if (result.has_value()) {
+			// The stacked layout is decoded while writing, so do not leave a truncated file behind.
+			output.close();
+			std::filesystem::remove(outputPath, ec);
+			result->message.append(": ").append(inputPath);
 			return result;
+		}
 		output.close();
 		if (output.fail())
 			return IoError { std::string("Failed to write to output file: ")
@@ -211,7 +268,6 @@ std::optional<IoError> Run(const Options &options)
 			std::filesystem::remove(inputPathFs);
 		}
 		if (!options.quiet) {
-			std::error_code ec;
 			const uintmax_t outputFileSize = std::filesystem::file_size(outputPath, ec);
 			if (ec)
 				return IoError { ec.message() };
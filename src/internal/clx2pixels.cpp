@@ -1,34 +1,40 @@
 #include <clx2pixels.hpp>
 
+#include <cstdint>
 #include <cstring>
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <limits>
 #include <span>
+#include <string>
+#include <vector>
 
+#include "blit_primitives.hpp"
 #include "clx_decode.hpp"
+#include "cpu_dispatch.hpp"
+#include "parallel_for.hpp"
+#include "rect_packer.hpp"
+
+#ifdef DVL_GFX_X86_DISPATCH
+#include <immintrin.h>
+#endif
 
 namespace dvl_gfx {
 
 namespace {
 
-void BlitFillDirect(uint8_t *dst, unsigned length, uint8_t color)
-{
-	std::memset(dst, color, length);
-}
-
-void BlitPixelsDirect(uint8_t *dst, const uint8_t *src, unsigned length)
-{
-	std::memcpy(dst, src, length);
-}
-
-void BlitClxCommand(ClxBlitCommand cmd, uint8_t *dst, const uint8_t *src)
+template <CpuIsa Isa>
+DVL_GFX_ALWAYS_INLINE void BlitClxCommand(ClxBlitCommand cmd, uint8_t *dst, const uint8_t *src)
 {
 	switch (cmd.type) {
 	case ClxBlitType::Fill:
-		BlitFillDirect(dst, cmd.length, cmd.color);
+		BlitFill<Isa>(dst, cmd.length, cmd.color);
 		return;
 	case ClxBlitType::Pixels:
-		BlitPixelsDirect(dst, src, cmd.length);
+		BlitPixels<Isa>(dst, src, cmd.length);
 		return;
 	case ClxBlitType::Transparent:
 		return;
@@ -47,59 +53,796 @@ SkipSize GetSkipSize(int_fast16_t overrun, int_fast16_t srcWidth)
 	return result;
 }
 
-void BlitClxSprite(std::span<const uint8_t> clxSprite, uint8_t *dstBegin, unsigned dstPitch)
+/**
+ * @brief How `BlitClxSprite` draws a sprite.
+ */
+enum class BlitMode : uint8_t {
+	/**
+	 * @brief Only draws the opaque pixels. An opaque command that runs past the end
+	 * of its line continues to draw to the right of the sprite.
+	 */
+	Overlay,
+
+	/**
+	 * @brief Only draws the opaque pixels, and only within the sprite rectangle.
+	 * Stops before an opaque command that runs past the end of its line.
+	 */
+	OverlayWithinLines,
+
+	/**
+	 * @brief Only draws the opaque pixels, and only within the sprite rectangle.
+	 * The part of an opaque command that runs past the end of its line is not drawn.
+	 */
+	OverlayClipped,
+
+	/**
+	 * @brief Like `OverlayClipped`, but also only draws the columns in
+	 * [`ClxLines::clipLeft`, `ClxLines::clipRight`).
+	 */
+	OverlayClippedToColumns,
+
+	/**
+	 * @brief Draws the transparent pixels as well, writing each pixel of the sprite
+	 * rectangle exactly once. Stops before an opaque command that runs past the end of its line.
+	 */
+	Opaque,
+
+	/**
+	 * @brief Like `Opaque`, for sprites that passed `ValidateClx` with
+	 * `ClxSpriteProperties::opaqueCommandsWithinLines` and `ClxSpriteProperties::coversAllPixels`.
+	 * The commands cover the sprite exactly, so the end of the data is never checked.
+	 * Like `Opaque`, does not draw the `xOffset` pixels of the first line before the first command,
+	 * and stops after `numLines` lines even if the commands continue onto the lines above.
+	 */
+	OpaqueValidated,
+
+	/**
+	 * @brief Like `Overlay`, for the same sprites as `OpaqueValidated`. Draws only the
+	 * opaque commands and steps over the transparent ones without any checks.
+	 */
+	OverlayValidated,
+};
+
+/**
+ * @brief A range of lines of a CLX sprite.
+ */
+struct ClxLines {
+	// The first command to draw. Starts `xOffset` pixels into the first line.
+	const uint8_t *src;
+	const uint8_t *srcEnd;
+	uint16_t width;
+	unsigned numLines;
+	int_fast16_t xOffset;
+	// The columns to draw in `BlitMode::OverlayClippedToColumns`.
+	int_fast16_t clipLeft;
+	int_fast16_t clipRight;
+};
+
+ClxLines GetAllClxLines(std::span<const uint8_t> clxSprite)
 {
-	int_fast16_t xOffset = 0;
+	return ClxLines {
+		GetClxSpritePixelsData(clxSprite.data()),
+		clxSprite.data() + clxSprite.size(),
+		GetClxSpriteWidth(clxSprite.data()),
+		GetClxSpriteHeight(clxSprite.data()),
+		0,
+		0,
+		GetClxSpriteWidth(clxSprite.data()),
+	};
+}
 
-	const uint16_t srcWidth = GetClxSpriteWidth(clxSprite.data());
-	const uint8_t *srcBegin = GetClxSpritePixelsData(clxSprite.data());
-	const uint8_t *srcEnd = clxSprite.data() + clxSprite.size();
+/**
+ * @brief Draws lines of a CLX sprite, bottom line first.
+ *
+ * @param dstBegin The first pixel of the bottom line to draw.
+ * @return False if the lines were not drawn completely because an opaque command
+ *     ran past the end of its line (never for `BlitMode::Overlay`).
+ */
+template <CpuIsa Isa, BlitMode Mode>
+DVL_GFX_ALWAYS_INLINE bool BlitClxLinesImpl(const ClxLines &lines, uint8_t *dstBegin, unsigned dstPitch,
+    [[maybe_unused]] uint8_t transparentColor)
+{
+	if constexpr (Mode == BlitMode::OpaqueValidated || Mode == BlitMode::OverlayValidated) {
+		const uint8_t *src = lines.src;
+		const unsigned width = lines.width;
+		if (width == 0)
+			return true;
+		uint8_t *dst = dstBegin;
+		unsigned x = static_cast<unsigned>(lines.xOffset);
+		for (unsigned line = 0; line < lines.numLines;) {
+			const ClxBlitCommand cmd = ClxGetBlitCommand(src);
+			if (cmd.type == ClxBlitType::Transparent && Mode == BlitMode::OverlayValidated) {
+				// Transparent runs may continue onto the lines above,
+				// past the last line to draw if that is not the top line of the sprite.
+				x += cmd.length;
+				while (x >= width) {
+					x -= width;
+					dst -= dstPitch;
+					if (++line == lines.numLines)
+						return true;
+				}
+			} else if (cmd.type == ClxBlitType::Transparent) {
+				unsigned length = cmd.length;
+				while (length >= width - x) {
+					BlitFill<Isa>(dst + x, width - x, transparentColor);
+					length -= width - x;
+					x = 0;
+					dst -= dstPitch;
+					if (++line == lines.numLines)
+						return true;
+				}
+				BlitFill<Isa>(dst + x, length, transparentColor);
+				x += length;
+			} else {
+				BlitClxCommand<Isa>(cmd, dst + x, src + 1);
+				x += cmd.length;
+				if (x == width) {
+					x = 0;
+					dst -= dstPitch;
+					++line;
+				}
+			}
+			src = cmd.srcEnd;
+		}
+		return true;
+	}
+
+	int_fast16_t xOffset = lines.xOffset;
+	const uint16_t srcWidth = lines.width;
+	const unsigned numLines = lines.numLines;
+	const uint8_t *srcBegin = lines.src;
+	const uint8_t *srcEnd = lines.srcEnd;
 
 	uint8_t *dst = dstBegin;
-	while (srcBegin != srcEnd) {
+	unsigned line = 0;
+	while (srcBegin != srcEnd && line < numLines) {
 		auto remainingWidth = static_cast<int_fast16_t>(srcWidth) - xOffset;
 		dst += xOffset;
 		while (remainingWidth > 0) {
 			ClxBlitCommand cmd = ClxGetBlitCommand(srcBegin);
-			BlitClxCommand(cmd, dst, srcBegin + 1);
+			if constexpr (Mode == BlitMode::Opaque) {
+				if (cmd.type == ClxBlitType::Transparent) {
+					BlitFill<Isa>(dst, std::min<int_fast16_t>(cmd.length, remainingWidth), transparentColor);
+				} else if (static_cast<int_fast16_t>(cmd.length) > remainingWidth) {
+					return false;
+				} else {
+					BlitClxCommand<Isa>(cmd, dst, srcBegin + 1);
+				}
+			} else if constexpr (Mode == BlitMode::OverlayWithinLines) {
+				if (cmd.type != ClxBlitType::Transparent && static_cast<int_fast16_t>(cmd.length) > remainingWidth)
+					return false;
+				BlitClxCommand<Isa>(cmd, dst, srcBegin + 1);
+			} else if constexpr (Mode == BlitMode::OverlayClipped) {
+				if (cmd.type != ClxBlitType::Transparent && static_cast<int_fast16_t>(cmd.length) > remainingWidth) [[unlikely]] {
+					ClxBlitCommand clipped = cmd;
+					clipped.length = static_cast<unsigned>(remainingWidth);
+					BlitClxCommand<Isa>(clipped, dst, srcBegin + 1);
+				} else {
+					BlitClxCommand<Isa>(cmd, dst, srcBegin + 1);
+				}
+			} else if constexpr (Mode == BlitMode::OverlayClippedToColumns) {
+				if (cmd.type != ClxBlitType::Transparent) {
+					const int_fast16_t x = srcWidth - remainingWidth;
+					const int_fast16_t begin = std::max(x, lines.clipLeft);
+					const int_fast16_t end = std::min(static_cast<int_fast16_t>(x + cmd.length), lines.clipRight);
+					if (begin < end) {
+						ClxBlitCommand clipped = cmd;
+						clipped.length = static_cast<unsigned>(end - begin);
+						BlitClxCommand<Isa>(clipped, dst + (begin - x), srcBegin + 1 + (begin - x));
+					}
+				}
+			} else {
+				BlitClxCommand<Isa>(cmd, dst, srcBegin + 1);
+			}
 			srcBegin = cmd.srcEnd;
 			dst += cmd.length;
 			remainingWidth -= cmd.length;
 		}
 		dst -= dstPitch + srcWidth - remainingWidth;
+		++line;
 
 		if (remainingWidth < 0) {
+			// In the modes that stop at opaque overruns, this is a transparent run.
+			// In `BlitMode::OverlayClipped`, the rest of the run is outside of the sprite.
 			const auto skipSize = GetSkipSize(-remainingWidth, static_cast<int_fast16_t>(srcWidth));
+			if constexpr (Mode == BlitMode::Opaque) {
+				// The transparent run continues onto the lines above.
+				for (int_fast16_t i = 0; i < skipSize.wholeLines && line < numLines; ++i, ++line)
+					BlitFill<Isa>(dst - i * dstPitch, srcWidth, transparentColor);
+				if (line < numLines)
+					BlitFill<Isa>(dst - skipSize.wholeLines * dstPitch, skipSize.xOffset, transparentColor);
+			} else {
+				line += skipSize.wholeLines;
+			}
 			xOffset = skipSize.xOffset;
 			dst -= skipSize.wholeLines * dstPitch;
 		} else {
 			xOffset = 0;
 		}
 	}
+	if constexpr (Mode == BlitMode::Opaque) {
+		// Lines that the sprite data does not cover.
+		for (; line < numLines; ++line, dst -= dstPitch)
+			BlitFill<Isa>(dst, srcWidth, transparentColor);
+	}
+	return true;
 }
 
-Size BlitClxSpriteList(
-    std::span<const uint8_t> clxList,
-    uint8_t transparentColor,
-    uint8_t *pixels,
-    unsigned pitch,
-    uint32_t x)
+template <BlitMode Mode>
+bool BlitClxLinesScalar(const ClxLines &lines, uint8_t *dstBegin, unsigned dstPitch, uint8_t transparentColor)
 {
-	const uint32_t numSprites = GetNumSpritesFromClxList(clxList.data());
-	uint32_t y = 0;
-	Size size { 0, 0 };
-	for (size_t i = 0; i < numSprites; ++i) {
+	return BlitClxLinesImpl<CpuIsa::Scalar, Mode>(lines, dstBegin, dstPitch, transparentColor);
+}
+
+#ifdef DVL_GFX_X86_DISPATCH
+template <BlitMode Mode>
+DVL_GFX_TARGET_SSE42 bool BlitClxLinesSse42(const ClxLines &lines, uint8_t *dstBegin, unsigned dstPitch, uint8_t transparentColor)
+{
+	return BlitClxLinesImpl<CpuIsa::Sse42, Mode>(lines, dstBegin, dstPitch, transparentColor);
+}
+
+template <BlitMode Mode>
+DVL_GFX_TARGET_AVX2 bool BlitClxLinesAvx2(const ClxLines &lines, uint8_t *dstBegin, unsigned dstPitch, uint8_t transparentColor)
+{
+	return BlitClxLinesImpl<CpuIsa::Avx2, Mode>(lines, dstBegin, dstPitch, transparentColor);
+}
+
+template <BlitMode Mode>
+DVL_GFX_TARGET_AVX512 bool BlitClxLinesAvx512(const ClxLines &lines, uint8_t *dstBegin, unsigned dstPitch, uint8_t transparentColor)
+{
+	return BlitClxLinesImpl<CpuIsa::Avx512, Mode>(lines, dstBegin, dstPitch, transparentColor);
+}
+#endif
+
+template <BlitMode Mode>
+bool BlitClxLines(const ClxLines &lines, uint8_t *dstBegin, unsigned dstPitch, uint8_t transparentColor)
+{
+	switch (GetCpuIsa()) {
+#ifdef DVL_GFX_X86_DISPATCH
+	case CpuIsa::Avx512:
+		return BlitClxLinesAvx512<Mode>(lines, dstBegin, dstPitch, transparentColor);
+	case CpuIsa::Avx2:
+		return BlitClxLinesAvx2<Mode>(lines, dstBegin, dstPitch, transparentColor);
+	case CpuIsa::Sse42:
+		return BlitClxLinesSse42<Mode>(lines, dstBegin, dstPitch, transparentColor);
+#endif
+	default:
+		return BlitClxLinesScalar<Mode>(lines, dstBegin, dstPitch, transparentColor);
+	}
+}
+
+/**
+ * @brief Draws a whole CLX sprite, bottom line first.
+ *
+ * @param dstBegin The first pixel of the bottom line of the sprite.
+ */
+template <BlitMode Mode>
+bool BlitClxSprite(std::span<const uint8_t> clxSprite, uint8_t *dstBegin, unsigned dstPitch, uint8_t transparentColor)
+{
+	return BlitClxLines<Mode>(GetAllClxLines(clxSprite), dstBegin, dstPitch, transparentColor);
+}
+
+/** @brief The 32-bit color of transparent pixels: transparent black in any channel order. */
+constexpr uint32_t RgbaTransparent = 0;
+
+DVL_GFX_ALWAYS_INLINE void FillRgbaDirect(uint32_t *dst, unsigned length, uint32_t color)
+{
+	std::fill_n(dst, length, color);
+}
+
+DVL_GFX_ALWAYS_INLINE void LookupRgbaDirect(uint32_t *dst, const uint8_t *src, unsigned length, const uint32_t *palette)
+{
+	for (unsigned i = 0; i < length; ++i)
+		dst[i] = palette[src[i]];
+}
+
+#ifdef DVL_GFX_X86_DISPATCH
+DVL_GFX_TARGET_SSE42 inline void FillRgbaSse42(uint32_t *dst, unsigned length, uint32_t color)
+{
+	if (length < 4) {
+		FillRgbaDirect(dst, length, color);
+		return;
+	}
+	const __m128i v = _mm_set1_epi32(static_cast<int>(color));
+	for (unsigned i = 0; i + 4 < length; i += 4)
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), v);
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + length - 4), v);
+}
+
+DVL_GFX_TARGET_AVX2 inline void FillRgbaAvx2(uint32_t *dst, unsigned length, uint32_t color)
+{
+	if (length < 8) {
+		FillRgbaSse42(dst, length, color);
+		return;
+	}
+	const __m256i v = _mm256_set1_epi32(static_cast<int>(color));
+	for (unsigned i = 0; i + 8 < length; i += 8)
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), v);
+	_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + length - 8), v);
+}
+
+/** @brief Looks up 8 pixels with a single gather. */
+DVL_GFX_TARGET_AVX2 inline void LookupRgba8Avx2(uint32_t *dst, const uint8_t *src, const uint32_t *palette)
+{
+	const __m256i indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src)));
+	_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst),
+	    _mm256_i32gather_epi32(reinterpret_cast<const int *>(palette), indices, 4));
+}
+
+DVL_GFX_TARGET_AVX2 inline void LookupRgbaAvx2(uint32_t *dst, const uint8_t *src, unsigned length, const uint32_t *palette)
+{
+	if (length < 8) {
+		LookupRgbaDirect(dst, src, length, palette);
+		return;
+	}
+	for (unsigned i = 0; i + 8 < length; i += 8)
+		LookupRgba8Avx2(dst + i, src + i, palette);
+	LookupRgba8Avx2(dst + length - 8, src + length - 8, palette);
+}
+
+DVL_GFX_TARGET_AVX512 inline void FillRgbaAvx512(uint32_t *dst, unsigned length, uint32_t color)
+{
+	const __m512i v = _mm512_set1_epi32(static_cast<int>(color));
+	for (; length > 16; length -= 16, dst += 16)
+		_mm512_storeu_si512(dst, v);
+	_mm512_mask_storeu_epi32(dst, static_cast<__mmask16>(_bzhi_u32(0xFFFF, length)), v);
+}
+
+DVL_GFX_TARGET_AVX512 inline void LookupRgbaAvx512(uint32_t *dst, const uint8_t *src, unsigned length, const uint32_t *palette)
+{
+	// The masked forms with a zero source are used throughout, as GCC 12 warns about the
+	// undefined source of the unmasked forms (-Wmaybe-uninitialized).
+	constexpr __mmask16 AllLanes = 0xFFFF;
+	for (; length > 16; length -= 16, dst += 16, src += 16) {
+		const __m512i indices = _mm512_maskz_cvtepu8_epi32(AllLanes, _mm_loadu_si128(reinterpret_cast<const __m128i *>(src)));
+		_mm512_storeu_si512(dst, _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), AllLanes, indices, palette, 4));
+	}
+	const auto mask = static_cast<__mmask16>(_bzhi_u32(0xFFFF, length));
+	alignas(16) uint8_t tail[16] = {};
+	std::memcpy(tail, src, length);
+	const __m512i indices = _mm512_maskz_cvtepu8_epi32(mask, _mm_load_si128(reinterpret_cast<const __m128i *>(tail)));
+	_mm512_mask_storeu_epi32(dst, mask, _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), mask, indices, palette, 4));
+}
+#endif
+
+template <CpuIsa Isa>
+DVL_GFX_ALWAYS_INLINE void FillRgba(uint32_t *dst, unsigned length, uint32_t color)
+{
+#ifdef DVL_GFX_X86_DISPATCH
+	if constexpr (Isa == CpuIsa::Avx512) {
+		FillRgbaAvx512(dst, length, color);
+		return;
+	} else if constexpr (Isa == CpuIsa::Avx2) {
+		FillRgbaAvx2(dst, length, color);
+		return;
+	} else if constexpr (Isa == CpuIsa::Sse42) {
+		FillRgbaSse42(dst, length, color);
+		return;
+	}
+#endif
+	FillRgbaDirect(dst, length, color);
+}
+
+/**
+ * @brief Writes the palette colors of `length` palette indices.
+ *
+ * There is no SSE4.2 gather, so SSE4.2 uses the scalar loop.
+ */
+template <CpuIsa Isa>
+DVL_GFX_ALWAYS_INLINE void LookupRgba(uint32_t *dst, const uint8_t *src, unsigned length, const uint32_t *palette)
+{
+#ifdef DVL_GFX_X86_DISPATCH
+	if constexpr (Isa == CpuIsa::Avx512) {
+		LookupRgbaAvx512(dst, src, length, palette);
+		return;
+	} else if constexpr (Isa == CpuIsa::Avx2) {
+		LookupRgbaAvx2(dst, src, length, palette);
+		return;
+	}
+#endif
+	LookupRgbaDirect(dst, src, length, palette);
+}
+
+/**
+ * @brief Draws lines of a CLX sprite as 32-bit colors, like `BlitClxLinesImpl`.
+ *
+ * Only `BlitMode::Overlay` and `BlitMode::Opaque` are supported.
+ * Transparent pixels are written as `RgbaTransparent`.
+ *
+ * @param palette 256 32-bit colors.
+ */
+template <CpuIsa Isa, BlitMode Mode>
+DVL_GFX_ALWAYS_INLINE bool BlitClxLinesRgbaImpl(const ClxLines &lines, uint32_t *dstBegin, unsigned dstPitch,
+    const uint32_t *palette)
+{
+	static_assert(Mode == BlitMode::Overlay || Mode == BlitMode::OverlayClippedToColumns || Mode == BlitMode::Opaque);
+	int_fast16_t xOffset = lines.xOffset;
+	const uint16_t srcWidth = lines.width;
+	const unsigned numLines = lines.numLines;
+	const uint8_t *srcBegin = lines.src;
+	const uint8_t *srcEnd = lines.srcEnd;
+
+	uint32_t *dst = dstBegin;
+	unsigned line = 0;
+	while (srcBegin != srcEnd && line < numLines) {
+		auto remainingWidth = static_cast<int_fast16_t>(srcWidth) - xOffset;
+		dst += xOffset;
+		while (remainingWidth > 0) {
+			const ClxBlitCommand cmd = ClxGetBlitCommand(srcBegin);
+			if (cmd.type == ClxBlitType::Transparent) {
+				if constexpr (Mode == BlitMode::Opaque)
+					FillRgba<Isa>(dst, std::min<int_fast16_t>(cmd.length, remainingWidth), RgbaTransparent);
+			} else {
+				int_fast16_t begin = 0;
+				int_fast16_t end = cmd.length;
+				if constexpr (Mode == BlitMode::Opaque) {
+					if (end > remainingWidth)
+						return false;
+				} else if constexpr (Mode == BlitMode::OverlayClippedToColumns) {
+					const int_fast16_t x = srcWidth - remainingWidth;
+					begin = std::max<int_fast16_t>(0, lines.clipLeft - x);
+					end = std::min<int_fast16_t>(end, lines.clipRight - x);
+				}
+				if (begin < end) {
+					if (cmd.type == ClxBlitType::Fill) {
+						FillRgba<Isa>(dst + begin, end - begin, palette[cmd.color]);
+					} else {
+						LookupRgba<Isa>(dst + begin, srcBegin + 1 + begin, end - begin, palette);
+					}
+				}
+			}
+			srcBegin = cmd.srcEnd;
+			dst += cmd.length;
+			remainingWidth -= cmd.length;
+		}
+		dst -= dstPitch + srcWidth - remainingWidth;
+		++line;
+
+		if (remainingWidth < 0) {
+			const auto skipSize = GetSkipSize(-remainingWidth, static_cast<int_fast16_t>(srcWidth));
+			if constexpr (Mode == BlitMode::Opaque) {
+				for (int_fast16_t i = 0; i < skipSize.wholeLines && line < numLines; ++i, ++line)
+					FillRgba<Isa>(dst - i * dstPitch, srcWidth, RgbaTransparent);
+				if (line < numLines)
+					FillRgba<Isa>(dst - skipSize.wholeLines * dstPitch, skipSize.xOffset, RgbaTransparent);
+			} else {
+				line += skipSize.wholeLines;
+			}
+			xOffset = skipSize.xOffset;
+			dst -= skipSize.wholeLines * dstPitch;
+		} else {
+			xOffset = 0;
+		}
+	}
+	if constexpr (Mode == BlitMode::Opaque) {
+		for (; line < numLines; ++line, dst -= dstPitch)
+			FillRgba<Isa>(dst, srcWidth, RgbaTransparent);
+	}
+	return true;
+}
+
+template <BlitMode Mode>
+bool BlitClxLinesRgbaScalar(const ClxLines &lines, uint32_t *dstBegin, unsigned dstPitch, const uint32_t *palette)
+{
+	return BlitClxLinesRgbaImpl<CpuIsa::Scalar, Mode>(lines, dstBegin, dstPitch, palette);
+}
+
+#ifdef DVL_GFX_X86_DISPATCH
+template <BlitMode Mode>
+DVL_GFX_TARGET_SSE42 bool BlitClxLinesRgbaSse42(const ClxLines &lines, uint32_t *dstBegin, unsigned dstPitch, const uint32_t *palette)
+{
+	return BlitClxLinesRgbaImpl<CpuIsa::Sse42, Mode>(lines, dstBegin, dstPitch, palette);
+}
+
+template <BlitMode Mode>
+DVL_GFX_TARGET_AVX2 bool BlitClxLinesRgbaAvx2(const ClxLines &lines, uint32_t *dstBegin, unsigned dstPitch, const uint32_t *palette)
+{
+	return BlitClxLinesRgbaImpl<CpuIsa::Avx2, Mode>(lines, dstBegin, dstPitch, palette);
+}
+
+template <BlitMode Mode>
+DVL_GFX_TARGET_AVX512 bool BlitClxLinesRgbaAvx512(const ClxLines &lines, uint32_t *dstBegin, unsigned dstPitch, const uint32_t *palette)
+{
+	return BlitClxLinesRgbaImpl<CpuIsa::Avx512, Mode>(lines, dstBegin, dstPitch, palette);
+}
+#endif
+
+template <BlitMode Mode>
+bool BlitClxLinesRgba(const ClxLines &lines, uint32_t *dstBegin, unsigned dstPitch, const uint32_t *palette)
+{
+	switch (GetCpuIsa()) {
+#ifdef DVL_GFX_X86_DISPATCH
+	case CpuIsa::Avx512:
+		return BlitClxLinesRgbaAvx512<Mode>(lines, dstBegin, dstPitch, palette);
+	case CpuIsa::Avx2:
+		return BlitClxLinesRgbaAvx2<Mode>(lines, dstBegin, dstPitch, palette);
+	case CpuIsa::Sse42:
+		return BlitClxLinesRgbaSse42<Mode>(lines, dstBegin, dstPitch, palette);
+#endif
+	default:
+		return BlitClxLinesRgbaScalar<Mode>(lines, dstBegin, dstPitch, palette);
+	}
+}
+
+struct ClxSpritePlacement {
+	std::span<const uint8_t> clxSprite;
+	// Position of the top-left corner of the sprite in the output.
+	uint32_t x;
+	uint32_t y;
+	// Width of the list that the sprite belongs to.
+	uint32_t listWidth;
+};
+
+struct ClxListPlacement {
+	uint32_t x;
+	Size size;
+	// The sprites of the list are [`firstSprite`, `endSprite`) in the sprite placements.
+	size_t firstSprite;
+	size_t endSprite;
+};
+
+/**
+ * @return The size of a sprite dimension when drawn at 1/`scale` of the size.
+ */
+constexpr uint32_t ScaleClxDimension(uint32_t size, unsigned scale)
+{
+	return (size + scale - 1) / scale;
+}
+
+/**
+ * @brief Computes the position of every sprite from the frame headers alone.
+ *
+ * Lists are stacked horizontally, and sprites within each list vertically.
+ *
+ * @param scale The sprites are drawn at 1/`scale` of their size.
+ * @return The size of the resulting image.
+ */
+Size PlaceClxSprites(std::span<const uint8_t> clxData,
+    std::vector<ClxSpritePlacement> &sprites, std::vector<ClxListPlacement> &lists, unsigned scale = 1)
+{
+	const uint32_t numLists = GetNumListsFromClxListOrSheetBuffer(clxData);
+	Size imageSize { 0, 0 };
+	for (size_t i = 0; i < std::max<uint32_t>(numLists, 1); ++i) {
+		const std::span<const uint8_t> clxList = numLists == 0 ? clxData : GetClxListFromClxSheetBuffer(clxData, i);
+		const uint32_t numSprites = GetNumSpritesFromClxList(clxList.data());
+		const size_t firstSprite = sprites.size();
+		Size listSize { 0, 0 };
+		for (size_t j = 0; j < numSprites; ++j) {
+			const std::span<const uint8_t> clxSprite = GetSpriteDataFromClxList(clxList.data(), j);
+			sprites.push_back(ClxSpritePlacement { clxSprite, imageSize.width, listSize.height, 0 });
+			listSize.width = std::max(listSize.width, ScaleClxDimension(GetClxSpriteWidth(clxSprite.data()), scale));
+			listSize.height += ScaleClxDimension(GetClxSpriteHeight(clxSprite.data()), scale);
+		}
+		for (size_t j = firstSprite; j < sprites.size(); ++j)
+			sprites[j].listWidth = listSize.width;
+		lists.push_back(ClxListPlacement { imageSize.width, listSize, firstSprite, sprites.size() });
+		imageSize.width += listSize.width;
+		imageSize.height = std::max(imageSize.height, listSize.height);
+	}
+	return imageSize;
+}
+
+/**
+ * @brief Writes palette indices as they are.
+ */
+struct IndexedColor {
+	using Pixel = uint8_t;
+	Pixel operator()(uint8_t color) const
+	{
+		return color;
+	}
+};
+
+/**
+ * @brief Looks palette indices up in a table of 32-bit colors.
+ */
+struct RgbaColor {
+	using Pixel = uint32_t;
+	const uint32_t *palette;
+	Pixel operator()(uint8_t color) const
+	{
+		return palette[color];
+	}
+};
+
+/**
+ * @brief Draws the opaque pixels of a CLX sprite at 1/`Scale` of its size, bottom line first.
+ *
+ * Each output pixel is the top-left pixel of its `Scale x Scale` block. Only the lines
+ * that contain such pixels are drawn, and only those pixels of them. The commands of the
+ * other lines are stepped over without being decoded.
+ *
+ * @param dst The first pixel of output line `rowBegin`.
+ * @param toPixel Converts a palette index to an output pixel.
+ * @param rowBegin, rowEnd Only the output lines in [`rowBegin`, `rowEnd`) are drawn.
+ */
+template <unsigned Scale, typename ToPixel>
+void BlitClxSpriteScaledImpl(std::span<const uint8_t> clxSprite, typename ToPixel::Pixel *dst, unsigned dstPitch,
+    const ToPixel &toPixel, unsigned rowBegin, unsigned rowEnd)
+{
+	const unsigned width = GetClxSpriteWidth(clxSprite.data());
+	const unsigned height = GetClxSpriteHeight(clxSprite.data());
+	const uint8_t *src = GetClxSpritePixelsData(clxSprite.data());
+	const uint8_t *srcEnd = clxSprite.data() + clxSprite.size();
+	if (width == 0)
+		return;
+
+	// `line` counts from the bottom, and `x` is the pixel of the line that the next command begins at.
+	unsigned line = 0;
+	unsigned x = 0;
+	while (src != srcEnd && line < height) {
+		const unsigned y = height - 1 - line;
+		if (y / Scale < rowBegin)
+			break;
+		if (y % Scale != 0 || y / Scale >= rowEnd) {
+			while (x < width) {
+				const ClxControlInfo info = ClxControlTable[*src];
+				x += info.length;
+				src += info.srcAdvance;
+			}
+		} else {
+			typename ToPixel::Pixel *out = &dst[static_cast<size_t>(y / Scale - rowBegin) * dstPitch];
+			while (x < width) {
+				const ClxBlitCommand cmd = ClxGetBlitCommand(src);
+				if (cmd.type != ClxBlitType::Transparent) {
+					const unsigned end = std::min(x + cmd.length, width);
+					// The first sampled pixel at or after `x`.
+					unsigned sample = (x + Scale - 1) & ~(Scale - 1);
+					if (cmd.type == ClxBlitType::Fill) {
+						const typename ToPixel::Pixel color = toPixel(cmd.color);
+						for (; sample < end; sample += Scale)
+							out[sample / Scale] = color;
+					} else {
+						for (; sample < end; sample += Scale)
+							out[sample / Scale] = toPixel(src[1 + sample - x]);
+					}
+				}
+				x += cmd.length;
+				src = cmd.srcEnd;
+			}
+		}
+		line += x / width;
+		x %= width;
+	}
+}
+
+template <typename ToPixel>
+void BlitClxSpriteScaled(std::span<const uint8_t> clxSprite, typename ToPixel::Pixel *dst, unsigned dstPitch,
+    unsigned scale, const ToPixel &toPixel, unsigned rowBegin = 0, unsigned rowEnd = std::numeric_limits<unsigned>::max())
+{
+	switch (scale) {
+	case 2:
+		BlitClxSpriteScaledImpl<2>(clxSprite, dst, dstPitch, toPixel, rowBegin, rowEnd);
+		break;
+	case 4:
+		BlitClxSpriteScaledImpl<4>(clxSprite, dst, dstPitch, toPixel, rowBegin, rowEnd);
+		break;
+	case 8:
+		BlitClxSpriteScaledImpl<8>(clxSprite, dst, dstPitch, toPixel, rowBegin, rowEnd);
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * @brief Draws the opaque pixels of the sprites at 1/`scale` of their size on up to `numThreads` threads.
+ */
+template <typename ToPixel = IndexedColor>
+void BlitClxSpritesScaled(std::span<const ClxSpritePlacement> sprites,
+    typename ToPixel::Pixel *pixels, unsigned pitch, unsigned scale, unsigned numThreads,
+    const ToPixel &toPixel = {})
+{
+	ParallelFor(sprites.size(), numThreads, [&](size_t i) {
+		const ClxSpritePlacement &sprite = sprites[i];
+		BlitClxSpriteScaled(sprite.clxSprite, &pixels[static_cast<size_t>(sprite.y) * pitch + sprite.x], pitch, scale, toPixel);
+	});
+}
+
+/**
+ * @brief The most pixels that an opaque command can run past the end of its line:
+ * one less than the longest command.
+ */
+constexpr unsigned MaxClxOverrun = 64;
+
+/**
+ * @brief Whether an opaque command that runs past the end of a line of the sprite
+ * could run past the end of the output line as well.
+ *
+ * In `BlitMode::Overlay`, such runs are drawn in full, over the columns of the
+ * lists to the right, like the games do with the CL2-derived data that has them.
+ */
+bool IsNearRightEdge(const ClxSpritePlacement &sprite, uint16_t width, unsigned pitch)
+{
+	return pitch - sprite.x - width < MaxClxOverrun;
+}
+
+/**
+ * @brief All the lines of a sprite near the right edge of the output, to draw in
+ * `BlitMode::OverlayClippedToColumns` so that runs stop at the end of the output line.
+ */
+ClxLines GetClxLinesToRightEdge(const ClxSpritePlacement &sprite, unsigned pitch)
+{
+	ClxLines lines = GetAllClxLines(sprite.clxSprite);
+	lines.clipRight = static_cast<int_fast16_t>(pitch - sprite.x);
+	return lines;
+}
+
+/**
+ * @brief Draws the sprites on up to `numThreads` threads.
+ *
+ * The sprite rectangles are disjoint, so the sprites can be drawn in any order,
+ * as long as none of them draws outside of its rectangle.
+ *
+ * @param validatedSprites In `BlitMode::Opaque`, the properties of every sprite if the data
+ *     has been validated, to draw the sprites that allow it with `BlitMode::OpaqueValidated`.
+ *
+ * @return False if some sprite was not drawn completely (see `BlitClxLinesImpl`).
+ */
+template <BlitMode Mode>
+bool BlitClxSprites(std::span<const ClxSpritePlacement> sprites,
+    uint8_t transparentColor, uint8_t *pixels, unsigned pitch, unsigned numThreads,
+    std::span<const ClxSpriteProperties> validatedSprites = {})
+{
+	std::atomic<bool> complete { true };
+	ParallelFor(sprites.size(), numThreads, [&](size_t i) {
+		const ClxSpritePlacement &sprite = sprites[i];
+		const uint16_t width = GetClxSpriteWidth(sprite.clxSprite.data());
+		const uint16_t height = GetClxSpriteHeight(sprite.clxSprite.data());
+		if (height == 0)
+			return;
 		// CLX sprite data is organized bottom to top.
 		// The start of the output is the first pixel of the last line of the sprite.
-		const std::span<const uint8_t> clxSprite = GetSpriteDataFromClxList(clxList.data(), i);
-		const uint16_t height = GetClxSpriteHeight(clxSprite.data());
-		uint8_t *dstBegin = &pixels[(y + height - 1) * pitch + x];
-		BlitClxSprite(clxSprite, dstBegin, pitch);
-		y += height;
-		size.width = std::max<uint32_t>(size.width, GetClxSpriteWidth(clxSprite.data()));
-	}
-	size.height = y;
-	return size;
+		uint8_t *dstBegin = &pixels[static_cast<size_t>(sprite.y + height - 1) * pitch + sprite.x];
+		if (Mode == BlitMode::Opaque && !validatedSprites.empty()
+		    && validatedSprites[i].opaqueCommandsWithinLines && validatedSprites[i].coversAllPixels) {
+			BlitClxSprite<BlitMode::OpaqueValidated>(sprite.clxSprite, dstBegin, pitch, transparentColor);
+		} else if (Mode == BlitMode::Overlay && IsNearRightEdge(sprite, width, pitch)) {
+			BlitClxLines<BlitMode::OverlayClippedToColumns>(
+			    GetClxLinesToRightEdge(sprite, pitch), dstBegin, pitch, transparentColor);
+		} else if (!BlitClxSprite<Mode>(sprite.clxSprite, dstBegin, pitch, transparentColor)) {
+			complete.store(false, std::memory_order_relaxed);
+			return;
+		}
+		if constexpr (Mode == BlitMode::Opaque) {
+			if (width < sprite.listWidth) {
+				for (unsigned row = 0; row < height; ++row)
+					std::memset(&pixels[static_cast<size_t>(sprite.y + row) * pitch + sprite.x + width], transparentColor, sprite.listWidth - width);
+			}
+		}
+	});
+	return complete.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Draws the sprites as 32-bit colors on up to `numThreads` threads, like `BlitClxSprites`.
+ */
+template <BlitMode Mode>
+bool BlitClxSpritesRgba(std::span<const ClxSpritePlacement> sprites,
+    const uint32_t *palette, uint32_t *pixels, unsigned pitch, unsigned numThreads)
+{
+	std::atomic<bool> complete { true };
+	ParallelFor(sprites.size(), numThreads, [&](size_t i) {
+		const ClxSpritePlacement &sprite = sprites[i];
+		const uint16_t width = GetClxSpriteWidth(sprite.clxSprite.data());
+		const uint16_t height = GetClxSpriteHeight(sprite.clxSprite.data());
+		if (height == 0)
+			return;
+		uint32_t *dstBegin = &pixels[static_cast<size_t>(sprite.y + height - 1) * pitch + sprite.x];
+		if (Mode == BlitMode::Overlay && IsNearRightEdge(sprite, width, pitch)) {
+			BlitClxLinesRgba<BlitMode::OverlayClippedToColumns>(GetClxLinesToRightEdge(sprite, pitch), dstBegin, pitch, palette);
+		} else if (!BlitClxLinesRgba<Mode>(GetAllClxLines(sprite.clxSprite), dstBegin, pitch, palette)) {
+			complete.store(false, std::memory_order_relaxed);
+			return;
+		}
+		if constexpr (Mode == BlitMode::Opaque) {
+			if (width < sprite.listWidth) {
+				for (unsigned row = 0; row < height; ++row)
+					std::fill_n(&pixels[static_cast<size_t>(sprite.y + row) * pitch + sprite.x + width], sprite.listWidth - width, RgbaTransparent);
+			}
+		}
+	});
+	return complete.load(std::memory_order_relaxed);
 }
 
 void ConvertClxToPixels(
@@ -107,28 +850,238 @@ void ConvertClxToPixels(
     uint8_t transparentColor,
     uint8_t *pixels,
     unsigned pitch,
-    Size *outDimensions)
+    Size *outDimensions,
+    unsigned numThreads)
+{
+	std::vector<ClxSpritePlacement> sprites;
+	std::vector<ClxListPlacement> lists;
+	const Size imageSize = PlaceClxSprites(clxData, sprites, lists);
+	if (outDimensions != nullptr)
+		*outDimensions = imageSize;
+
+	// Sprites may only be drawn concurrently if none of them draws outside of its rectangle.
+	// If one would, draw them all again in order, so that the output is the same as drawing
+	// them in order in the first place: sprites drawn twice draw the same pixels.
+	if (numThreads != 1 && sprites.size() > 1
+	    && BlitClxSprites<BlitMode::OverlayWithinLines>(sprites, transparentColor, pixels, pitch, numThreads))
+		return;
+	BlitClxSprites<BlitMode::Overlay>(sprites, transparentColor, pixels, pitch, /*numThreads=*/1);
+}
+
+size_t CountClxSprites(std::span<const uint8_t> clxData)
 {
 	const uint32_t numLists = GetNumListsFromClxListOrSheetBuffer(clxData);
-	if (numLists == 0) {
-		const Size size = BlitClxSpriteList(
-		    clxData, transparentColor, pixels, pitch, /*x=*/0);
-		if (outDimensions != nullptr) {
-			*outDimensions = size;
+	if (numLists == 0)
+		return GetNumSpritesFromClxList(clxData.data());
+	size_t result = 0;
+	for (size_t i = 0; i < numLists; ++i)
+		result += GetNumSpritesFromClxList(GetClxListFromClxSheetBuffer(clxData, i).data());
+	return result;
+}
+
+/**
+ * @brief Draws a CLX list or sheet, writing every pixel of the `imageSize.height * pitch`
+ * output exactly once. Transparent pixels and the padding to the right of and below
+ * the sprites are written as `transparentColor`.
+ *
+ * @return False if the output is incomplete and must be drawn with `ConvertClxToPixels` instead.
+ */
+bool ConvertClxToPixelsOpaque(
+    std::span<const uint8_t> clxData,
+    uint8_t transparentColor,
+    uint8_t *pixels,
+    unsigned pitch,
+    unsigned numThreads,
+    std::span<const ClxSpriteProperties> validatedSprites)
+{
+	std::vector<ClxSpritePlacement> sprites;
+	std::vector<ClxListPlacement> lists;
+	const Size imageSize = PlaceClxSprites(clxData, sprites, lists);
+	if (!BlitClxSprites<BlitMode::Opaque>(sprites, transparentColor, pixels, pitch, numThreads, validatedSprites))
+		return false;
+	for (const ClxListPlacement &list : lists) {
+		for (uint32_t y = list.size.height; y < imageSize.height; ++y)
+			std::memset(&pixels[static_cast<size_t>(y) * pitch + list.x], transparentColor, list.size.width);
+	}
+	if (imageSize.width < pitch) {
+		for (uint32_t y = 0; y < imageSize.height; ++y)
+			std::memset(&pixels[static_cast<size_t>(y) * pitch + imageSize.width], transparentColor, pitch - imageSize.width);
+	}
+	return true;
+}
+
+/**
+ * @brief The sprites of a list are stacked top to bottom, so skip the ones above line `firstLine`.
+ */
+std::span<const ClxSpritePlacement>::iterator FindFirstClxSpriteInBand(
+    std::span<const ClxSpritePlacement> listSprites, unsigned firstLine, unsigned scale)
+{
+	return std::partition_point(listSprites.begin(), listSprites.end(), [&](const ClxSpritePlacement &sprite) {
+		return sprite.y + ScaleClxDimension(GetClxSpriteHeight(sprite.clxSprite.data()), scale) <= firstLine;
+	});
+}
+
+/**
+ * @brief Draws lines [`firstLine`, `firstLine + numLines`) of the image that `Clx2Pixels`
+ * draws, with the lists stacked horizontally and the sprites within each list vertically.
+ *
+ * Draws the sprites that intersect the lines in the same order and in the same way as
+ * `ConvertClxToPixels` in `BlitMode::Overlay`, so the lines are the same as in the whole image,
+ * including the parts of opaque commands that run past the end of their line.
+ *
+ * @param validatedSprites The properties of every sprite if the data has been validated,
+ *     to draw the sprites that allow it with `BlitMode::OverlayValidated`.
+ * @param pixels The first pixel of line `firstLine`. The lines must be filled with the transparent color.
+ * @param pitch The width of the image.
+ */
+void BlitClxSpritesBand(std::span<const ClxSpritePlacement> sprites, std::span<const ClxListPlacement> lists,
+    unsigned firstLine, unsigned numLines, unsigned scale, uint8_t transparentColor,
+    std::span<const ClxSpriteProperties> validatedSprites, uint8_t *pixels, unsigned pitch)
+{
+	const unsigned endLine = firstLine + numLines;
+	for (const ClxListPlacement &list : lists) {
+		const auto listSprites = sprites.subspan(list.firstSprite, list.endSprite - list.firstSprite);
+		for (auto it = FindFirstClxSpriteInBand(listSprites, firstLine, scale); it != listSprites.end() && it->y < endLine; ++it) {
+			const ClxSpritePlacement &sprite = *it;
+			const uint16_t width = GetClxSpriteWidth(sprite.clxSprite.data());
+			const uint16_t height = GetClxSpriteHeight(sprite.clxSprite.data());
+			// The lines of the sprite to draw, counting from its top.
+			const unsigned top = std::max(firstLine, sprite.y) - sprite.y;
+			const unsigned bottom = std::min(endLine, sprite.y + ScaleClxDimension(height, scale)) - sprite.y;
+			if (scale != 1) {
+				BlitClxSpriteScaled(sprite.clxSprite, &pixels[static_cast<size_t>(sprite.y + top - firstLine) * pitch + sprite.x],
+				    pitch, scale, IndexedColor {}, top, bottom);
+				continue;
+			}
+
+			// CLX sprite data is organized bottom to top, so start at the bottom line of the band.
+			// An opaque command that begins below it only draws on the line where it begins.
+			const ClxLinePosition pos = FindClxSpriteLine(sprite.clxSprite, height - bottom);
+			if (pos.line >= height - top)
+				continue;
+			ClxLines lines {
+				pos.src,
+				sprite.clxSprite.data() + sprite.clxSprite.size(),
+				width,
+				height - top - pos.line,
+				static_cast<int_fast16_t>(pos.xOffset),
+				0,
+				width,
+			};
+			uint8_t *lineBegin = &pixels[static_cast<size_t>(sprite.y + height - 1 - pos.line - firstLine) * pitch + sprite.x];
+			const ClxSpriteProperties *properties = validatedSprites.empty()
+			    ? nullptr
+			    : &validatedSprites[list.firstSprite + static_cast<size_t>(it - listSprites.begin())];
+			if (properties != nullptr && properties->opaqueCommandsWithinLines && properties->coversAllPixels) {
+				// No command runs past the end of its line, so none can reach the right edge.
+				BlitClxLines<BlitMode::OverlayValidated>(lines, lineBegin, pitch, transparentColor);
+			} else if (IsNearRightEdge(sprite, width, pitch)) {
+				lines.clipRight = static_cast<int_fast16_t>(pitch - sprite.x);
+				BlitClxLines<BlitMode::OverlayClippedToColumns>(lines, lineBegin, pitch, transparentColor);
+			} else {
+				BlitClxLines<BlitMode::Overlay>(lines, lineBegin, pitch, transparentColor);
+			}
 		}
-		return;
 	}
-	uint32_t height = 0;
-	uint32_t x = 0;
-	for (size_t i = 0; i < numLists; ++i) {
-		const Size size = BlitClxSpriteList(GetClxListFromClxSheetBuffer(clxData, i),
-		    transparentColor, pixels, pitch, x);
-		x += size.width;
-		height = std::max(height, size.height);
+}
+
+/**
+ * @brief Converts a 768-byte RGB palette to 32-bit colors in the given channel order with an alpha of 255.
+ */
+std::array<uint32_t, 256> ToRgbaPalette(std::span<const uint8_t> palette, ClxRgbaFormat format)
+{
+	std::array<uint32_t, 256> result;
+	for (size_t i = 0; i < result.size(); ++i) {
+		const uint8_t *rgb = &palette[i * 3];
+		const uint8_t bytes[4] = {
+			format == ClxRgbaFormat::Rgba ? rgb[0] : rgb[2],
+			rgb[1],
+			format == ClxRgbaFormat::Rgba ? rgb[2] : rgb[0],
+			0xFF,
+		};
+		std::memcpy(&result[i], bytes, 4);
 	}
-	if (outDimensions != nullptr) {
-		*outDimensions = Size { x, height };
+	return result;
+}
+
+/**
+ * @brief Calls `fn(line, begin, end)` for every run of opaque pixels of a CLX sprite,
+ * with `line` counting from the bottom. Only reads the control bytes.
+ *
+ * Adjacent opaque commands form a single run. Runs are clipped to the end of their line.
+ */
+template <typename Fn>
+void ForEachClxOpaqueRun(std::span<const uint8_t> clxSprite, Fn &&fn)
+{
+	const unsigned width = GetClxSpriteWidth(clxSprite.data());
+	const unsigned height = GetClxSpriteHeight(clxSprite.data());
+	const uint8_t *src = GetClxSpritePixelsData(clxSprite.data());
+	const uint8_t *srcEnd = clxSprite.data() + clxSprite.size();
+	if (width == 0)
+		return;
+
+	unsigned line = 0;
+	unsigned x = 0;
+	// The start of the current opaque run, if `inRun`.
+	unsigned runBegin = 0;
+	bool inRun = false;
+	while (src != srcEnd && line < height) {
+		const ClxBlitCommand cmd = ClxGetBlitCommand(src);
+		src = cmd.srcEnd;
+		if (cmd.type == ClxBlitType::Transparent) {
+			if (inRun) {
+				fn(line, runBegin, x);
+				inRun = false;
+			}
+		} else if (!inRun) {
+			runBegin = x;
+			inRun = true;
+		}
+		x += cmd.length;
+		if (x >= width) {
+			if (inRun) {
+				fn(line, runBegin, width);
+				inRun = false;
+			}
+			x -= width;
+			++line;
+			if (x >= width) [[unlikely]] {
+				// A transparent run, or the rest of an opaque one, that covers whole lines.
+				line += x / width;
+				x %= width;
+			}
+		}
+	}
+	if (inRun)
+		fn(line, runBegin, x);
+}
+
+/**
+ * @brief Sets bits `[begin, end)` of a mask line.
+ */
+void SetMaskBits(uint64_t *line, size_t begin, size_t end)
+{
+	const size_t first = begin / 64;
+	const size_t last = (end - 1) / 64;
+	const uint64_t firstMask = ~uint64_t { 0 } << (begin % 64);
+	const uint64_t lastMask = ~uint64_t { 0 } >> (63 - (end - 1) % 64);
+	if (first == last) {
+		line[first] |= firstMask & lastMask;
+		return;
 	}
+	line[first] |= firstMask;
+	std::fill(line + first + 1, line + last, ~uint64_t { 0 });
+	line[last] |= lastMask;
+}
+
+bool IsSupportedClxDecodeScale(unsigned scale)
+{
+	return scale == 1 || scale == 2 || scale == 4 || scale == 8;
+}
+
+IoError UnsupportedScaleError(unsigned scale)
+{
+	return IoError { std::string("Unsupported scale, must be 1, 2, 4 or 8: ").append(std::to_string(scale)) };
 }
 
 } // namespace
@@ -160,14 +1113,149 @@ Size MeasureHorizontallyStackedClxListOrSheetSize(std::span<const uint8_t> clxDa
 	return result;
 }
 
+void ClxSprite2Pixels(std::span<const uint8_t> clxSprite, uint8_t *pixels, unsigned pitch)
+{
+	const uint16_t height = GetClxSpriteHeight(clxSprite.data());
+	if (height == 0)
+		return;
+	// CLX sprite data is organized bottom to top.
+	BlitClxSprite<BlitMode::OverlayClipped>(
+	    clxSprite, &pixels[static_cast<size_t>(height - 1) * pitch], pitch, /*transparentColor=*/0);
+}
+
+void ClxSpriteLines2Pixels(std::span<const uint8_t> clxSprite, unsigned firstLine, unsigned numLines,
+    uint8_t *pixels, unsigned pitch)
+{
+	const ClxSurface surface { pixels, GetClxSpriteWidth(clxSprite.data()), numLines, pitch };
+	DrawClxSprite(clxSprite, surface, 0, -static_cast<int64_t>(firstLine));
+}
+
+void DrawClxSprite(std::span<const uint8_t> clxSprite, const ClxSurface &surface, int64_t x, int64_t y,
+    std::optional<ClxRect> clip)
+{
+	const uint16_t width = GetClxSpriteWidth(clxSprite.data());
+	const uint16_t height = GetClxSpriteHeight(clxSprite.data());
+
+	int64_t clipLeft = 0;
+	int64_t clipTop = 0;
+	int64_t clipRight = surface.width;
+	int64_t clipBottom = surface.height;
+	if (clip.has_value()) {
+		clipLeft = std::max<int64_t>(clipLeft, clip->x);
+		clipTop = std::max<int64_t>(clipTop, clip->y);
+		clipRight = std::min<int64_t>(clipRight, clip->x + static_cast<int64_t>(clip->width));
+		clipBottom = std::min<int64_t>(clipBottom, clip->y + static_cast<int64_t>(clip->height));
+	}
+
+	// The visible part of the sprite, in sprite coordinates.
+	const auto left = static_cast<int_fast16_t>(std::clamp<int64_t>(clipLeft - x, 0, width));
+	const auto right = static_cast<int_fast16_t>(std::clamp<int64_t>(clipRight - x, 0, width));
+	const auto top = static_cast<unsigned>(std::clamp<int64_t>(clipTop - y, 0, height));
+	const auto bottom = static_cast<unsigned>(std::clamp<int64_t>(clipBottom - y, 0, height));
+	if (left >= right || top >= bottom)
+		return;
+
+	// CLX sprite data is organized bottom to top, so start at the bottom visible line.
+	// Lines below it are skipped, using the row-skip table if there is one.
+	const unsigned endLine = height - top;
+	const ClxLinePosition pos = FindClxSpriteLine(clxSprite, height - bottom);
+	if (pos.line >= endLine)
+		return;
+	const ClxLines lines {
+		pos.src,
+		clxSprite.data() + clxSprite.size(),
+		width,
+		endLine - pos.line,
+		static_cast<int_fast16_t>(pos.xOffset),
+		left,
+		right,
+	};
+	// The first pixel of line `pos.line`, which may be to the left of the surface.
+	uint8_t *dst = surface.pixels + (y + height - 1 - pos.line) * static_cast<int64_t>(surface.pitch) + x;
+	if (left == 0 && right == width) {
+		BlitClxLines<BlitMode::OverlayClipped>(lines, dst, surface.pitch, /*transparentColor=*/0);
+	} else {
+		BlitClxLines<BlitMode::OverlayClippedToColumns>(lines, dst, surface.pitch, /*transparentColor=*/0);
+	}
+}
+
+void ClxSpriteOpacityMask(std::span<const uint8_t> clxSprite, uint64_t *mask, size_t maskPitch)
+{
+	const unsigned width = GetClxSpriteWidth(clxSprite.data());
+	const unsigned height = GetClxSpriteHeight(clxSprite.data());
+	const size_t lineWords = (width + 63) / 64;
+	if (maskPitch == lineWords) {
+		std::fill_n(mask, height * lineWords, 0);
+	} else {
+		for (unsigned y = 0; y < height; ++y)
+			std::fill_n(&mask[y * maskPitch], lineWords, 0);
+	}
+	ForEachClxOpaqueRun(clxSprite, [&](unsigned line, unsigned begin, unsigned end) {
+		SetMaskBits(&mask[(height - 1 - line) * maskPitch], begin, end);
+	});
+}
+
+void ClxSpriteOpaqueSpans(std::span<const uint8_t> clxSprite,
+    std::vector<ClxOpaqueSpan> &spans, std::vector<uint32_t> &lineSpans)
+{
+	const unsigned height = GetClxSpriteHeight(clxSprite.data());
+	spans.clear();
+	lineSpans.assign(height + 1, 0);
+
+	// The runs come bottom line first and left to right. Reversing all of them
+	// and then the spans of each line puts them top line first and left to right.
+	ForEachClxOpaqueRun(clxSprite, [&](unsigned line, unsigned begin, unsigned end) {
+		spans.push_back(ClxOpaqueSpan { static_cast<uint16_t>(begin), static_cast<uint16_t>(end) });
+		++lineSpans[height - line];
+	});
+	std::reverse(spans.begin(), spans.end());
+	for (unsigned y = 0; y < height; ++y) {
+		lineSpans[y + 1] += lineSpans[y];
+		std::reverse(spans.begin() + lineSpans[y], spans.begin() + lineSpans[y + 1]);
+	}
+}
+
+Size Clx2OpacityMask(std::span<const uint8_t> clxData, std::vector<uint64_t> &mask, std::optional<size_t> maskPitch)
+{
+	std::vector<ClxSpritePlacement> sprites;
+	std::vector<ClxListPlacement> lists;
+	const Size imageSize = PlaceClxSprites(clxData, sprites, lists);
+	if (!maskPitch.has_value())
+		maskPitch = (imageSize.width + 63) / 64;
+	const size_t size = imageSize.height * (*maskPitch);
+	if (mask.size() < size)
+		mask.resize(size);
+	std::fill_n(mask.begin(), size, 0);
+	for (const ClxSpritePlacement &sprite : sprites) {
+		const unsigned height = GetClxSpriteHeight(sprite.clxSprite.data());
+		uint64_t *spriteMask = &mask[static_cast<size_t>(sprite.y) * (*maskPitch)];
+		ForEachClxOpaqueRun(sprite.clxSprite, [&](unsigned line, unsigned begin, unsigned end) {
+			SetMaskBits(&spriteMask[(height - 1 - line) * (*maskPitch)], sprite.x + begin, sprite.x + end);
+		});
+	}
+	return imageSize;
+}
+
 std::optional<IoError> Clx2Pixels(
     std::span<const uint8_t> clxData,
     uint8_t transparentColor,
     uint8_t *pixels,
     unsigned pitch,
-    Size *outDimensions)
+    Size *outDimensions,
+    const ClxDecodeOptions &options)
 {
-	ConvertClxToPixels(clxData, transparentColor, pixels, pitch, outDimensions);
+	if (options.scale != 1) {
+		if (!IsSupportedClxDecodeScale(options.scale))
+			return UnsupportedScaleError(options.scale);
+		std::vector<ClxSpritePlacement> sprites;
+		std::vector<ClxListPlacement> lists;
+		const Size imageSize = PlaceClxSprites(clxData, sprites, lists, options.scale);
+		BlitClxSpritesScaled(sprites, pixels, pitch, options.scale, options.numThreads);
+		if (outDimensions != nullptr)
+			*outDimensions = imageSize;
+		return std::nullopt;
+	}
+	ConvertClxToPixels(clxData, transparentColor, pixels, pitch, outDimensions, options.numThreads);
 	return std::nullopt;
 }
 
@@ -176,19 +1264,218 @@ std::optional<IoError> Clx2Pixels(
     uint8_t transparentColor,
     std::vector<uint8_t> &pixels,
     std::optional<unsigned> pitch,
-    Size *outDimensions)
+    Size *outDimensions,
+    const ClxDecodeOptions &options)
 {
+	if (options.scale != 1) {
+		if (!IsSupportedClxDecodeScale(options.scale))
+			return UnsupportedScaleError(options.scale);
+		std::vector<ClxSpritePlacement> sprites;
+		std::vector<ClxListPlacement> lists;
+		const Size imageSize = PlaceClxSprites(clxData, sprites, lists, options.scale);
+		if (!pitch.has_value())
+			pitch = imageSize.width;
+		const size_t size = imageSize.height * (*pitch);
+		if (pixels.size() < size)
+			pixels.resize(size);
+		std::fill(pixels.begin(), pixels.begin() + size, transparentColor);
+		BlitClxSpritesScaled(sprites, pixels.data(), *pitch, options.scale, options.numThreads);
+		if (outDimensions != nullptr)
+			*outDimensions = imageSize;
+		return std::nullopt;
+	}
+
+	if (!options.validatedSprites.empty() && options.validatedSprites.size() != CountClxSprites(clxData))
+		return IoError { "ClxDecodeOptions::validatedSprites does not match the number of sprites" };
+
 	const Size measuredSize = MeasureHorizontallyStackedClxListOrSheetSize(clxData);
 	if (!pitch.has_value())
 		pitch = measuredSize.width;
 	const size_t size = measuredSize.height * (*pitch);
-	if (pixels.size() < size) {
-		pixels.resize(size, transparentColor);
-		std::fill(pixels.begin(), pixels.end(), transparentColor);
+	if (pixels.size() < size)
+		pixels.resize(size);
+
+	// Draw every pixel once, including the transparent ones, rather than
+	// clearing the whole buffer first and then drawing only the opaque ones.
+	if (ConvertClxToPixelsOpaque(clxData, transparentColor, pixels.data(), *pitch, options.numThreads, options.validatedSprites)) {
+		if (outDimensions != nullptr)
+			*outDimensions = measuredSize;
+		return std::nullopt;
+	}
+
+	// Some opaque command runs past the end of its line and draws over the pixels
+	// to its right. Those must not be overwritten by the transparent pixels there.
+	std::fill(pixels.begin(), pixels.begin() + size, transparentColor);
+	ConvertClxToPixels(clxData, transparentColor, pixels.data(), *pitch, outDimensions, /*numThreads=*/1);
+	return std::nullopt;
+}
+
+std::optional<IoError> Clx2PixelsPacked(
+    std::span<const uint8_t> clxData,
+    uint8_t transparentColor,
+    std::vector<uint8_t> &pixels,
+    std::vector<ClxFrameRect> &frameRects,
+    Size *outDimensions,
+    const ClxDecodeOptions &options,
+    std::optional<unsigned> atlasWidth)
+{
+	if (!IsSupportedClxDecodeScale(options.scale))
+		return UnsupportedScaleError(options.scale);
+
+	std::vector<ClxSpritePlacement> sprites;
+	std::vector<ClxListPlacement> lists;
+	PlaceClxSprites(clxData, sprites, lists, options.scale);
+
+	std::vector<Size> sizes;
+	sizes.reserve(sprites.size());
+	uint32_t maxWidth = 0;
+	for (const ClxSpritePlacement &sprite : sprites) {
+		const Size size {
+			ScaleClxDimension(GetClxSpriteWidth(sprite.clxSprite.data()), options.scale),
+			ScaleClxDimension(GetClxSpriteHeight(sprite.clxSprite.data()), options.scale),
+		};
+		maxWidth = std::max(maxWidth, size.width);
+		sizes.push_back(size);
+	}
+	if (atlasWidth.has_value() && *atlasWidth < maxWidth) {
+		return IoError { std::string("Atlas width ").append(std::to_string(*atlasWidth))
+			                 .append(" is smaller than the widest frame: ").append(std::to_string(maxWidth)) };
+	}
+
+	std::vector<PackedPosition> positions;
+	const Size imageSize = PackRects(sizes, atlasWidth, positions);
+
+	frameRects.clear();
+	frameRects.reserve(sprites.size());
+	const uint32_t numLists = GetNumListsFromClxListOrSheetBuffer(clxData);
+	for (size_t i = 0, sprite = 0; i < std::max<uint32_t>(numLists, 1); ++i) {
+		const uint32_t numSprites = GetNumSpritesFromClxList(
+		    (numLists == 0 ? clxData : GetClxListFromClxSheetBuffer(clxData, i)).data());
+		for (uint32_t j = 0; j < numSprites; ++j, ++sprite) {
+			sprites[sprite].x = positions[sprite].x;
+			sprites[sprite].y = positions[sprite].y;
+			sprites[sprite].listWidth = sizes[sprite].width;
+			frameRects.push_back(ClxFrameRect {
+			    static_cast<uint32_t>(i), j,
+			    positions[sprite].x, positions[sprite].y,
+			    sizes[sprite].width, sizes[sprite].height });
+		}
+	}
+
+	const size_t size = static_cast<size_t>(imageSize.height) * imageSize.width;
+	if (pixels.size() < size)
+		pixels.resize(size);
+	std::fill_n(pixels.begin(), size, transparentColor);
+	if (options.scale != 1) {
+		BlitClxSpritesScaled(sprites, pixels.data(), imageSize.width, options.scale, options.numThreads);
 	} else {
-		std::fill(pixels.begin(), pixels.begin() + size, transparentColor);
+		// The frames are packed edge to edge, so each one must be clipped to its own rectangle.
+		BlitClxSprites<BlitMode::OverlayClipped>(sprites, transparentColor, pixels.data(), imageSize.width, options.numThreads);
 	}
-	ConvertClxToPixels(clxData, transparentColor, pixels.data(), *pitch, outDimensions);
+	if (outDimensions != nullptr)
+		*outDimensions = imageSize;
+	return std::nullopt;
+}
+
+std::optional<IoError> Clx2PixelBands(
+    std::span<const uint8_t> clxData,
+    uint8_t transparentColor,
+    unsigned bandHeight,
+    const std::function<std::optional<IoError>(const ClxPixelBand &band)> &consumer,
+    const ClxDecodeOptions &options)
+{
+	if (!IsSupportedClxDecodeScale(options.scale))
+		return UnsupportedScaleError(options.scale);
+
+	std::vector<ClxSpritePlacement> sprites;
+	std::vector<ClxListPlacement> lists;
+	const Size imageSize = PlaceClxSprites(clxData, sprites, lists, options.scale);
+	if (!options.validatedSprites.empty() && options.validatedSprites.size() != sprites.size())
+		return IoError { "ClxDecodeOptions::validatedSprites does not match the number of sprites" };
+	if (imageSize.height == 0)
+		return consumer(ClxPixelBand { imageSize, 0, 0, {} });
+	if (bandHeight == 0) {
+		// A sprite that a band boundary cuts through is stepped over from its bottom line
+		// in both bands, so bands as tall as the tallest sprite step over each sprite at most twice.
+		for (const ClxSpritePlacement &sprite : sprites)
+			bandHeight = std::max(bandHeight, ScaleClxDimension(GetClxSpriteHeight(sprite.clxSprite.data()), options.scale));
+	}
+
+	// Bands are independent of each other, so draw up to one per thread at a time
+	// and pass them on in order.
+	const size_t bandSize = static_cast<size_t>(bandHeight) * imageSize.width;
+	const unsigned numBands = (imageSize.height + bandHeight - 1) / bandHeight;
+	const unsigned numThreads = std::min(ResolveNumThreads(options.numThreads), numBands);
+	std::vector<uint8_t> pixels(bandSize * numThreads);
+	for (unsigned groupBegin = 0; groupBegin < numBands; groupBegin += numThreads) {
+		const unsigned groupSize = std::min(numThreads, numBands - groupBegin);
+		ParallelFor(groupSize, numThreads, [&](size_t i) {
+			const unsigned firstLine = (groupBegin + static_cast<unsigned>(i)) * bandHeight;
+			const unsigned numLines = std::min(bandHeight, imageSize.height - firstLine);
+			uint8_t *band = &pixels[i * bandSize];
+			std::memset(band, transparentColor, static_cast<size_t>(numLines) * imageSize.width);
+			BlitClxSpritesBand(sprites, lists, firstLine, numLines, options.scale, transparentColor,
+			    options.validatedSprites, band, imageSize.width);
+		});
+		for (unsigned i = 0; i < groupSize; ++i) {
+			const unsigned firstLine = (groupBegin + i) * bandHeight;
+			const unsigned numLines = std::min(bandHeight, imageSize.height - firstLine);
+			const std::span<const uint8_t> band { &pixels[i * bandSize], static_cast<size_t>(numLines) * imageSize.width };
+			if (std::optional<IoError> error = consumer(ClxPixelBand { imageSize, firstLine, numLines, band }); error.has_value())
+				return error;
+		}
+	}
+	return std::nullopt;
+}
+
+std::optional<IoError> Clx2Rgba(
+    std::span<const uint8_t> clxData,
+    std::span<const uint8_t> palette,
+    ClxRgbaFormat format,
+    std::vector<uint32_t> &pixels,
+    std::optional<unsigned> pitch,
+    Size *outDimensions,
+    const ClxDecodeOptions &options)
+{
+	if (!IsSupportedClxDecodeScale(options.scale))
+		return UnsupportedScaleError(options.scale);
+	if (palette.size() < 768)
+		return IoError { std::string("Palette must be 768 bytes: ").append(std::to_string(palette.size())) };
+	const std::array<uint32_t, 256> rgbaPalette = ToRgbaPalette(palette, format);
+
+	std::vector<ClxSpritePlacement> sprites;
+	std::vector<ClxListPlacement> lists;
+	const Size imageSize = PlaceClxSprites(clxData, sprites, lists, options.scale);
+	if (outDimensions != nullptr)
+		*outDimensions = imageSize;
+	if (!pitch.has_value())
+		pitch = imageSize.width;
+	const size_t size = imageSize.height * static_cast<size_t>(*pitch);
+	if (pixels.size() < size)
+		pixels.resize(size);
+
+	if (options.scale != 1) {
+		std::fill_n(pixels.begin(), size, RgbaTransparent);
+		BlitClxSpritesScaled(sprites, pixels.data(), *pitch, options.scale, options.numThreads, RgbaColor { rgbaPalette.data() });
+		return std::nullopt;
+	}
+
+	// Like `Clx2Pixels`, write every pixel once if possible.
+	if (BlitClxSpritesRgba<BlitMode::Opaque>(sprites, rgbaPalette.data(), pixels.data(), *pitch, options.numThreads)) {
+		for (const ClxListPlacement &list : lists) {
+			for (uint32_t y = list.size.height; y < imageSize.height; ++y)
+				std::fill_n(&pixels[static_cast<size_t>(y) * (*pitch) + list.x], list.size.width, RgbaTransparent);
+		}
+		if (imageSize.width < *pitch) {
+			for (uint32_t y = 0; y < imageSize.height; ++y)
+				std::fill_n(&pixels[static_cast<size_t>(y) * (*pitch) + imageSize.width], *pitch - imageSize.width, RgbaTransparent);
+		}
+		return std::nullopt;
+	}
+
+	// Some opaque command runs past the end of its line, see `Clx2Pixels`.
+	std::fill_n(pixels.begin(), size, RgbaTransparent);
+	BlitClxSpritesRgba<BlitMode::Overlay>(sprites, rgbaPalette.data(), pixels.data(), *pitch, /*numThreads=*/1);
 	return std::nullopt;
 }
 
@@ -0,0 +1,298 @@
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <clx2pixels.hpp>
+#include <clx_validate.hpp>
+#include <dvl_gfx_common.hpp>
+
+#include "argument_parser.hpp"
+#include "palette_loader.hpp"
+#include "tl/expected.hpp"
+
+namespace dvl_gfx {
+namespace {
+
+constexpr char KHelp[] = R"(Usage: clx2rgba [options] files...
+
+Converts a CLX file to 32-bit RGBA. Transparent pixels are transparent black.
+
+Options:
+  --format <arg>               pam, tga, or raw (headerless pixels). Default: pam.
+  --bgra                       Write raw pixels in BGRA order instead of RGBA.
+  --output-dir <arg>           Output directory. Default: input file directory.
+  --palette <arg>              default, diablo_menu, hellfire_menu, or a path to a .pal file.
+  -j, --jobs <arg>             Number of threads to decode on, 0 for one per CPU core. Default: 1.
+  --scale <arg>                Downscale the sprites by 1, 2, 4 or 8, e.g. for thumbnails. Default: 1.
+  --remove                     Remove the input files.
+  -q, --quiet                  Do not log anything.
+)";
+
+enum class OutputFormat : uint8_t {
+	Pam,
+	Tga,
+	Raw,
+};
+
+struct Options {
+	std::vector<const char *> inputPaths;
+	std::optional<std::string_view> outputDir;
+	OutputFormat format = OutputFormat::Pam;
+	bool bgra = false;
+	std::string_view palette = "default";
+	ClxDecodeOptions decodeOptions;
+	bool remove = false;
+	bool quiet = false;
+};
+
+void PrintHelp()
+{
+	std::cerr << KHelp << std::endl;
+}
+
+tl::expected<Options, ArgumentError> ParseArguments(int argc, char *argv[])
+{
+	if (argc == 1) {
+		PrintHelp();
+		std::exit(64);
+	}
+	Options options;
+	ArgumentParserState state { 1, argc, argv };
+	for (; !state.atEnd(); ++state.pos) {
+		const std::string_view arg = state.arg();
+		if (arg == "-h" || arg == "--help") {
+			PrintHelp();
+			std::exit(0);
+		}
+		if (arg == "--format") {
+			tl::expected<std::string_view, ArgumentError> value = ParseArgumentValue(state);
+			if (!value.has_value())
+				return tl::unexpected { std::move(value).error() };
+			if (*value == "pam") {
+				options.format = OutputFormat::Pam;
+			} else if (*value == "tga") {
+				options.format = OutputFormat::Tga;
+			} else if (*value == "raw") {
+				options.format = OutputFormat::Raw;
+			} else {
+				return tl::unexpected { ArgumentError { "--format", "must be pam, tga or raw" } };
+			}
+		} else if (arg == "--bgra") {
+			options.bgra = true;
+		} else if (arg == "--output-dir") {
+			tl::expected<std::string_view, ArgumentError> value = ParseArgumentValue(state);
+			if (!value.has_value())
+				return tl::unexpected { std::move(value).error() };
+			options.outputDir = *value;
+		} else if (arg == "--palette") {
+			tl::expected<std::string_view, ArgumentError> value = ParseArgumentValue(state);
+			if (!value.has_value())
+				return tl::unexpected { std::move(value).error() };
+			options.palette = *value;
+		} else if (arg == "-j" || arg == "--jobs") {
+			tl::expected<unsigned, ArgumentError> value = ParseIntArgument<unsigned>(state);
+			if (!value.has_value())
+				return tl::unexpected { std::move(value).error() };
+			options.decodeOptions.numThreads = *value;
+		} else if (arg == "--scale") {
+			tl::expected<unsigned, ArgumentError> value = ParseIntArgument<unsigned>(state);
+			if (!value.has_value())
+				return tl::unexpected { std::move(value).error() };
+			if (*value != 1 && *value != 2 && *value != 4 && *value != 8)
+				return tl::unexpected { ArgumentError { "--scale", "must be 1, 2, 4 or 8" } };
+			options.decodeOptions.scale = *value;
+		} else if (arg == "--remove") {
+			options.remove = true;
+		} else if (arg == "-q" || arg == "--quiet") {
+			options.quiet = true;
+		} else if (arg.empty() || arg[0] == '-') {
+			return tl::unexpected { ArgumentError { arg, "unknown argument" } };
+		} else {
+			break;
+		}
+	}
+	if (options.bgra && options.format != OutputFormat::Raw)
+		return tl::unexpected { ArgumentError { "--bgra", "only applies to --format raw" } };
+	if (std::optional<ArgumentError> error = ParsePositionalArguments(state, "files...", options.inputPaths);
+	    error.has_value()) {
+		return tl::unexpected { *std::move(error) };
+	}
+	return options;
+}
+
+const char *GetExtension(OutputFormat format)
+{
+	switch (format) {
+	case OutputFormat::Pam:
+		return "pam";
+	case OutputFormat::Tga:
+		return "tga";
+	case OutputFormat::Raw:
+		return "rgba";
+	}
+	return "";
+}
+
+/**
+ * @brief Writes the header of a netpbm PAM image with an alpha channel.
+ */
+void WritePamHeader(Size size, std::ostream &out)
+{
+	out << "P7\nWIDTH " << size.width << "\nHEIGHT " << size.height
+	    << "\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n";
+}
+
+/**
+ * @brief Writes the header of an uncompressed 32-bit BGRA TGA image with the origin at the top left.
+ */
+std::optional<IoError> WriteTgaHeader(Size size, std::ostream &out)
+{
+	if (size.width > std::numeric_limits<uint16_t>::max() || size.height > std::numeric_limits<uint16_t>::max())
+		return IoError { "Image too large for TGA" };
+	const std::array<uint8_t, 18> header = {
+		0, // ID length
+		0, // No color map
+		2, // Uncompressed true-color
+		0, 0, 0, 0, 0, // Color map specification
+		0, 0, 0, 0, // X and Y origin
+		static_cast<uint8_t>(size.width), static_cast<uint8_t>(size.width >> 8),
+		static_cast<uint8_t>(size.height), static_cast<uint8_t>(size.height >> 8),
+		32, // Bits per pixel
+		0x28, // 8 alpha bits, top-left origin
+	};
+	out.write(reinterpret_cast<const char *>(header.data()), header.size());
+	return std::nullopt;
+}
+
+std::optional<IoError> Run(const Options &options)
+{
+	if (!options.quiet) {
+		std::clog << "file\tCLX\tRGBA\twidth\theight" << std::endl;
+	}
+
+	std::optional<std::filesystem::path> outputDirFs;
+	if (options.outputDir.has_value())
+		outputDirFs = *options.outputDir;
+
+	std::array<uint8_t, PaletteSize> palette;
+	if (std::optional<IoError> error = LoadPaletteArgument(options.palette, palette); error.has_value()) {
+		return error;
+	}
+	// TGA stores the channels in BGRA order.
+	const ClxRgbaFormat pixelFormat = options.format == OutputFormat::Tga || options.bgra
+	    ? ClxRgbaFormat::Bgra
+	    : ClxRgbaFormat::Rgba;
+
+	std::vector<uint32_t> pixels;
+	for (const char *inputPath : options.inputPaths) {
+		std::filesystem::path inputPathFs { inputPath };
+		std::filesystem::path outputPath;
+		if (outputDirFs.has_value()) {
+			outputPath = *outputDirFs / inputPathFs.filename().replace_extension(GetExtension(options.format));
+		} else {
+			outputPath = std::filesystem::path(inputPathFs).replace_extension(GetExtension(options.format));
+		}
+
+		Size dimensions;
+		uintmax_t inputFileSize;
+		{
+			std::error_code ec;
+			inputFileSize = std::filesystem::file_size(inputPath, ec);
+			if (ec)
+				return IoError { ec.message() };
+
+			std::ifstream input;
+			input.open(inputPath, std::ios::in | std::ios::binary);
+			if (input.fail())
+				return IoError { std::string("Failed to open input file: ")
+					                 .append(std::strerror(errno)) };
+			std::unique_ptr<uint8_t[]> ownedData { new uint8_t[inputFileSize] };
+			input.read(reinterpret_cast<char *>(ownedData.get()), static_cast<std::streamsize>(inputFileSize));
+			if (input.fail()) {
+				return IoError {
+					std::string("Failed to read CLX data: ").append(std::strerror(errno))
+				};
+			}
+			input.close();
+			std::span<const uint8_t> clxData(ownedData.get(), inputFileSize);
+			if (std::optional<IoError> error = ValidateClx(clxData); error.has_value()) {
+				error->message.append(": ").append(inputPath);
+				return error;
+			}
+			if (std::optional<IoError> error = Clx2Rgba(
+			        clxData, std::span(palette.data(), palette.size()), pixelFormat, pixels,
+			        /*pitch=*/std::nullopt, &dimensions, options.decodeOptions);
+			    error.has_value()) {
+				error->message.append(": ").append(inputPath);
+				return error;
+			}
+		}
+
+		std::ofstream output;
+		output.open(outputPath, std::ios::out | std::ios::binary);
+		if (output.fail())
+			return IoError { std::string("Failed to open output file: ")
+				                 .append(std::strerror(errno)) };
+
+		if (options.format == OutputFormat::Pam) {
+			WritePamHeader(dimensions, output);
+		} else if (options.format == OutputFormat::Tga) {
+			if (std::optional<IoError> error = WriteTgaHeader(dimensions, output); error.has_value()) {
+				error->message.append(": ").append(inputPath);
+				return error;
+			}
+		}
+		output.write(reinterpret_cast<const char *>(pixels.data()),
+		    static_cast<std::streamsize>(static_cast<size_t>(dimensions.width) * dimensions.height * 4));
+		output.close();
+		if (output.fail())
+			return IoError { std::string("Failed to write to output file: ")
+				                 .append(std::strerror(errno)) };
+
+		if (options.remove) {
+			std::filesystem::remove(inputPathFs);
+		}
+		if (!options.quiet) {
+			std::error_code ec;
+			const uintmax_t outputFileSize = std::filesystem::file_size(outputPath, ec);
+			if (ec)
+				return IoError { ec.message() };
+
+			std::clog << inputPathFs.stem().string() << "\t" << inputFileSize << "\t"
+			          << outputFileSize << "\t" << dimensions.width << "\t" << dimensions.height << std::endl;
+		}
+	}
+	return std::nullopt;
+}
+
+} // namespace
+} // namespace dvl_gfx
+
+int main(int argc, char *argv[])
+{
+	tl::expected<dvl_gfx::Options, dvl_gfx::ArgumentError> options = dvl_gfx::ParseArguments(argc, argv);
+	if (!options) {
+		std::cerr << options.error().arg << ": " << options.error().error
+		          << std::endl;
+		return 64;
+	}
+	if (std::optional<dvl_gfx::IoError> error = Run(*options);
+	    error.has_value()) {
+		std::cerr << error->message << std::endl;
+		return 1;
+	}
+	return 0;
+}
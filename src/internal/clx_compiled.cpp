@@ -0,0 +1,266 @@
+#include <clx_compiled.hpp>
+
+#include <cstdint>
+
+#include <algorithm>
+#include <span>
+#include <vector>
+
+#include "blit_primitives.hpp"
+#include "clx_decode.hpp"
+#include "cpu_dispatch.hpp"
+
+namespace dvl_gfx {
+
+namespace {
+
+/**
+ * @brief Fills at least this long are kept as fill spans rather than merged into
+ * adjacent pixel spans. Shorter ones cost about as much to copy as to fill.
+ */
+constexpr unsigned MinFillSpanLength = 16;
+
+struct ClxSpan {
+	unsigned line;
+	uint16_t x;
+	uint16_t length;
+	ClxSpanKind kind;
+	uint32_t data;
+};
+
+bool IsMergeableIntoPixels(const ClxSpan &span)
+{
+	return span.kind == ClxSpanKind::Pixels || span.length < MinFillSpanLength;
+}
+
+/**
+ * @brief Appends an opaque run, merging it into the previous span if they are adjacent.
+ *
+ * @param src The pixels of a `ClxSpanKind::Pixels` run.
+ */
+void AddSpan(ClxSpan span, const uint8_t *src, std::vector<ClxSpan> &spans, std::vector<uint8_t> &pixels)
+{
+	if (!spans.empty()) {
+		ClxSpan &prev = spans.back();
+		if (prev.line == span.line && prev.x + prev.length == span.x) {
+			if (prev.kind == ClxSpanKind::Fill && span.kind == ClxSpanKind::Fill && prev.data == span.data) {
+				prev.length += span.length;
+				return;
+			}
+			if (IsMergeableIntoPixels(prev) && IsMergeableIntoPixels(span)) {
+				if (prev.kind == ClxSpanKind::Fill) {
+					const auto color = static_cast<uint8_t>(prev.data);
+					prev.kind = ClxSpanKind::Pixels;
+					prev.data = static_cast<uint32_t>(pixels.size());
+					pixels.insert(pixels.end(), prev.length, color);
+				}
+				if (span.kind == ClxSpanKind::Fill) {
+					pixels.insert(pixels.end(), span.length, static_cast<uint8_t>(span.data));
+				} else {
+					pixels.insert(pixels.end(), src, src + span.length);
+				}
+				prev.length += span.length;
+				return;
+			}
+		}
+	}
+	if (span.kind == ClxSpanKind::Pixels) {
+		span.data = static_cast<uint32_t>(pixels.size());
+		pixels.insert(pixels.end(), src, src + span.length);
+	}
+	spans.push_back(span);
+}
+
+/**
+ * @brief Draws lines of a compiled sprite, top line first.
+ *
+ * @param dst The pixel of column 0 of line `firstLine` of the sprite.
+ * @param clipLeft The first column to draw, if `ClipColumns`.
+ * @param clipRight The column after the last one to draw, if `ClipColumns`.
+ */
+template <CpuIsa Isa, bool ClipColumns>
+DVL_GFX_ALWAYS_INLINE void DrawCompiledClxLinesImpl(const CompiledClxSprite &sprite, unsigned firstLine, unsigned endLine,
+    [[maybe_unused]] unsigned clipLeft, [[maybe_unused]] unsigned clipRight, uint8_t *dst, unsigned dstPitch)
+{
+	const uint32_t *lineSpans = sprite.lineSpans.data();
+	const uint16_t *spanX = sprite.spanX.data();
+	const uint16_t *spanLength = sprite.spanLength.data();
+	const ClxSpanKind *spanKind = sprite.spanKind.data();
+	const uint32_t *spanData = sprite.spanData.data();
+	const uint8_t *pixels = sprite.pixels.data();
+	for (unsigned line = firstLine; line < endLine; ++line, dst += dstPitch) {
+		const uint32_t spansEnd = lineSpans[line + 1];
+		for (uint32_t i = lineSpans[line]; i < spansEnd; ++i) {
+			unsigned begin = spanX[i];
+			unsigned end = begin + spanLength[i];
+			if constexpr (ClipColumns) {
+				begin = std::max(begin, clipLeft);
+				end = std::min(end, clipRight);
+				if (begin >= end)
+					continue;
+			}
+			if (spanKind[i] == ClxSpanKind::Fill) {
+				BlitFill<Isa>(dst + begin, end - begin, static_cast<uint8_t>(spanData[i]));
+			} else {
+				BlitPixels<Isa>(dst + begin, pixels + spanData[i] + (begin - spanX[i]), end - begin);
+			}
+		}
+	}
+}
+
+template <bool ClipColumns>
+void DrawCompiledClxLinesScalar(const CompiledClxSprite &sprite, unsigned firstLine, unsigned endLine,
+    unsigned clipLeft, unsigned clipRight, uint8_t *dst, unsigned dstPitch)
+{
+	DrawCompiledClxLinesImpl<CpuIsa::Scalar, ClipColumns>(sprite, firstLine, endLine, clipLeft, clipRight, dst, dstPitch);
+}
+
+#ifdef DVL_GFX_X86_DISPATCH
+template <bool ClipColumns>
+DVL_GFX_TARGET_SSE42 void DrawCompiledClxLinesSse42(const CompiledClxSprite &sprite, unsigned firstLine, unsigned endLine,
+    unsigned clipLeft, unsigned clipRight, uint8_t *dst, unsigned dstPitch)
+{
+	DrawCompiledClxLinesImpl<CpuIsa::Sse42, ClipColumns>(sprite, firstLine, endLine, clipLeft, clipRight, dst, dstPitch);
+}
+
+template <bool ClipColumns>
+DVL_GFX_TARGET_AVX2 void DrawCompiledClxLinesAvx2(const CompiledClxSprite &sprite, unsigned firstLine, unsigned endLine,
+    unsigned clipLeft, unsigned clipRight, uint8_t *dst, unsigned dstPitch)
+{
+	DrawCompiledClxLinesImpl<CpuIsa::Avx2, ClipColumns>(sprite, firstLine, endLine, clipLeft, clipRight, dst, dstPitch);
+}
+
+template <bool ClipColumns>
+DVL_GFX_TARGET_AVX512 void DrawCompiledClxLinesAvx512(const CompiledClxSprite &sprite, unsigned firstLine, unsigned endLine,
+    unsigned clipLeft, unsigned clipRight, uint8_t *dst, unsigned dstPitch)
+{
+	DrawCompiledClxLinesImpl<CpuIsa::Avx512, ClipColumns>(sprite, firstLine, endLine, clipLeft, clipRight, dst, dstPitch);
+}
+#endif
+
+template <bool ClipColumns>
+void DrawCompiledClxLines(const CompiledClxSprite &sprite, unsigned firstLine, unsigned endLine,
+    unsigned clipLeft, unsigned clipRight, uint8_t *dst, unsigned dstPitch)
+{
+	switch (GetCpuIsa()) {
+#ifdef DVL_GFX_X86_DISPATCH
+	case CpuIsa::Avx512:
+		return DrawCompiledClxLinesAvx512<ClipColumns>(sprite, firstLine, endLine, clipLeft, clipRight, dst, dstPitch);
+	case CpuIsa::Avx2:
+		return DrawCompiledClxLinesAvx2<ClipColumns>(sprite, firstLine, endLine, clipLeft, clipRight, dst, dstPitch);
+	case CpuIsa::Sse42:
+		return DrawCompiledClxLinesSse42<ClipColumns>(sprite, firstLine, endLine, clipLeft, clipRight, dst, dstPitch);
+#endif
+	default:
+		return DrawCompiledClxLinesScalar<ClipColumns>(sprite, firstLine, endLine, clipLeft, clipRight, dst, dstPitch);
+	}
+}
+
+} // namespace
+
+CompiledClxSprite CompileClxSprite(std::span<const uint8_t> clxSprite)
+{
+	CompiledClxSprite result;
+	result.width = GetClxSpriteWidth(clxSprite.data());
+	result.height = GetClxSpriteHeight(clxSprite.data());
+	const unsigned width = result.width;
+	const unsigned height = result.height;
+	result.lineSpans.assign(height + 1, 0);
+	if (width == 0)
+		return result;
+
+	// CLX lines are stored bottom to top, so collect the spans first and then store them top to bottom.
+	std::vector<ClxSpan> spans;
+	std::vector<uint8_t> pixels;
+	const uint8_t *src = GetClxSpritePixelsData(clxSprite.data());
+	const uint8_t *srcEnd = clxSprite.data() + clxSprite.size();
+	unsigned line = 0;
+	unsigned x = 0;
+	while (src != srcEnd && line < height) {
+		const ClxBlitCommand cmd = ClxGetBlitCommand(src);
+		if (cmd.type != ClxBlitType::Transparent) {
+			const ClxSpan span {
+				line,
+				static_cast<uint16_t>(x),
+				static_cast<uint16_t>(std::min(cmd.length, width - x)),
+				cmd.type == ClxBlitType::Fill ? ClxSpanKind::Fill : ClxSpanKind::Pixels,
+				cmd.color,
+			};
+			AddSpan(span, src + 1, spans, pixels);
+		}
+		x += cmd.length;
+		src = cmd.srcEnd;
+		line += x / width;
+		x %= width;
+	}
+
+	// The number of spans of each line, counting lines from the bottom.
+	std::vector<uint32_t> lineSpanCounts(height, 0);
+	for (const ClxSpan &span : spans)
+		++lineSpanCounts[span.line];
+	std::vector<uint32_t> bottomUpLineStarts(height + 1, 0);
+	for (unsigned i = 0; i < height; ++i)
+		bottomUpLineStarts[i + 1] = bottomUpLineStarts[i] + lineSpanCounts[i];
+
+	result.spanX.reserve(spans.size());
+	result.spanLength.reserve(spans.size());
+	result.spanKind.reserve(spans.size());
+	result.spanData.reserve(spans.size());
+	result.pixels.reserve(pixels.size());
+	for (unsigned y = 0; y < height; ++y) {
+		const unsigned bottomUpLine = height - 1 - y;
+		for (uint32_t i = bottomUpLineStarts[bottomUpLine]; i < bottomUpLineStarts[bottomUpLine + 1]; ++i) {
+			const ClxSpan &span = spans[i];
+			result.spanX.push_back(span.x);
+			result.spanLength.push_back(span.length);
+			result.spanKind.push_back(span.kind);
+			if (span.kind == ClxSpanKind::Pixels) {
+				// Store the pixels in drawing order too.
+				result.spanData.push_back(static_cast<uint32_t>(result.pixels.size()));
+				result.pixels.insert(result.pixels.end(), &pixels[span.data], &pixels[span.data] + span.length);
+			} else {
+				result.spanData.push_back(span.data);
+			}
+		}
+		result.lineSpans[y + 1] = static_cast<uint32_t>(result.spanX.size());
+	}
+	return result;
+}
+
+void CompiledClxSprite2Pixels(const CompiledClxSprite &sprite, uint8_t *pixels, unsigned pitch)
+{
+	DrawCompiledClxLines</*ClipColumns=*/false>(sprite, 0, sprite.height, 0, sprite.width, pixels, pitch);
+}
+
+void DrawCompiledClxSprite(const CompiledClxSprite &sprite, const ClxSurface &surface, int64_t x, int64_t y,
+    std::optional<ClxRect> clip)
+{
+	int64_t clipLeft = 0;
+	int64_t clipTop = 0;
+	int64_t clipRight = surface.width;
+	int64_t clipBottom = surface.height;
+	if (clip.has_value()) {
+		clipLeft = std::max<int64_t>(clipLeft, clip->x);
+		clipTop = std::max<int64_t>(clipTop, clip->y);
+		clipRight = std::min<int64_t>(clipRight, clip->x + static_cast<int64_t>(clip->width));
+		clipBottom = std::min<int64_t>(clipBottom, clip->y + static_cast<int64_t>(clip->height));
+	}
+
+	// The visible part of the sprite, in sprite coordinates.
+	const auto left = static_cast<unsigned>(std::clamp<int64_t>(clipLeft - x, 0, sprite.width));
+	const auto right = static_cast<unsigned>(std::clamp<int64_t>(clipRight - x, 0, sprite.width));
+	const auto top = static_cast<unsigned>(std::clamp<int64_t>(clipTop - y, 0, sprite.height));
+	const auto bottom = static_cast<unsigned>(std::clamp<int64_t>(clipBottom - y, 0, sprite.height));
+	if (left >= right || top >= bottom)
+		return;
+
+	// The pixel of column 0 of line `top`, which may be to the left of the surface.
+	uint8_t *dst = surface.pixels + (y + top) * static_cast<int64_t>(surface.pitch) + x;
+	if (left == 0 && right == sprite.width) {
+		DrawCompiledClxLines</*ClipColumns=*/false>(sprite, top, bottom, left, right, dst, surface.pitch);
+	} else {
+		DrawCompiledClxLines</*ClipColumns=*/true>(sprite, top, bottom, left, right, dst, surface.pitch);
+	}
+}
+
+} // namespace dvl_gfx
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <clx_decode.hpp>
+#include <dvl_gfx_common.hpp>
+#include <dvl_gfx_endian.hpp>
+
+namespace dvl_gfx {
+
+/**
+ * @brief Splits a CLX list or sheet into its lists, checking the list offset table.
+ *
+ * A single CLX list is returned as a sheet with one list. Tells lists and sheets apart
+ * the same way as `GetNumListsFromClxListOrSheetBuffer`.
+ *
+ * @param isSheet Set to whether the data is a CLX sheet.
+ */
+inline std::optional<IoError> SplitClxListOrSheet(std::span<const uint8_t> clxData,
+    std::vector<std::span<const uint8_t>> &lists, bool &isSheet)
+{
+	lists.clear();
+	if (clxData.size() < 4)
+		return IoError { "CLX data too small" };
+
+	if (GetNumListsFromClxListOrSheetBuffer(clxData) == 0) {
+		lists.push_back(clxData);
+		isSheet = false;
+		return std::nullopt;
+	}
+
+	// A CLX sheet starts with the offsets of its lists, the first of which is the size of that table.
+	const uint64_t listOffsetsSize = LoadLE32(clxData.data());
+	if (listOffsetsSize == 0 || listOffsetsSize % 4 != 0 || listOffsetsSize > clxData.size())
+		return IoError { "Not a CLX list or sheet: invalid list offset table" };
+	const size_t numLists = listOffsetsSize / 4;
+	lists.reserve(numLists);
+	for (size_t i = 0; i < numLists; ++i) {
+		const uint32_t begin = LoadLE32(&clxData[4 * i]);
+		// The last list extends to the end of the sheet.
+		const uint32_t end = i + 1 < numLists ? LoadLE32(&clxData[4 * (i + 1)]) : clxData.size();
+		if (begin < listOffsetsSize || begin > end || end > clxData.size())
+			return IoError { std::string("CLX list offset out of bounds: ").append(std::to_string(i)) };
+		lists.push_back(clxData.subspan(begin, end - begin));
+	}
+	isSheet = true;
+	return std::nullopt;
+}
+
+/**
+ * @brief Validates the frame offset table of a CLX list.
+ *
+ * Only reads the offset table itself, not the frames, so that opening a large
+ * memory-mapped file does not read all of it.
+ */
+inline std::optional<IoError> ValidateClxListOffsets(std::span<const uint8_t> clxList)
+{
+	if (clxList.size() < 4)
+		return IoError { "CLX list too small" };
+	const uint64_t numSprites = GetNumSpritesFromClxList(clxList.data());
+	const uint64_t offsetTableEnd = 4 + 4 * (numSprites + 1);
+	if (offsetTableEnd > clxList.size())
+		return IoError { "CLX list frame offset table out of bounds" };
+	uint64_t prevOffset = offsetTableEnd;
+	for (size_t i = 0; i <= numSprites; ++i) {
+		const uint32_t offset = GetSpriteOffsetFromClxList(clxList.data(), i);
+		if (offset > clxList.size())
+			return IoError { std::string("CLX frame offset out of bounds: ").append(std::to_string(i)) };
+		if (i != 0 && offset < prevOffset + ClxFrameHeaderSize)
+			return IoError { std::string("CLX frame too small: ").append(std::to_string(i - 1)) };
+		if (i == 0 && offset < prevOffset)
+			return IoError { "CLX frame overlaps the frame offset table" };
+		prevOffset = offset;
+	}
+	return std::nullopt;
+}
+
+} // namespace dvl_gfx
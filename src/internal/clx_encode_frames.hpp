@@ -0,0 +1,126 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include <clx_decode.hpp>
+#include <clx_encode.hpp>
+
+#include "parallel_for.hpp"
+
+namespace dvl_gfx {
+
+/**
+ * @brief Encodes `numFrames` independent frames one after another into `out`.
+ *
+ * `encodeFrame(frame, writer)` appends frame number `frame` to `writer`.
+ * `setFrameOffset(frame, pos)` is called with the position in `out` at which
+ * each frame begins, and finally with `frame = numFrames` and the end position.
+ *
+ * With more than one thread, the frames are encoded concurrently into separate
+ * buffers, which are then copied into `out` in order. Their offsets are the
+ * prefix sums of the buffer sizes, so the output is identical to the serial one.
+ * `encodeFrame` must therefore not depend on the position it writes at.
+ */
+template <typename Out, typename EncodeFrameFn, typename SetFrameOffsetFn>
+void EncodeClxFrames(size_t numFrames, unsigned numThreads, Out &out,
+    EncodeFrameFn &&encodeFrame, SetFrameOffsetFn &&setFrameOffset)
+{
+	if constexpr (std::is_same_v<Out, ClxWriter>) {
+		if (numFrames > 1 && ResolveNumThreads(numThreads) > 1) {
+			std::vector<std::vector<uint8_t>> frames(numFrames);
+			ParallelFor(numFrames, numThreads, [&](size_t frame) {
+				ClxWriter frameOut { frames[frame] };
+				encodeFrame(frame, frameOut);
+			});
+
+			size_t totalSize = 0;
+			for (const std::vector<uint8_t> &frameData : frames)
+				totalSize += frameData.size();
+			out.reserve(totalSize);
+			for (size_t frame = 0; frame < numFrames; ++frame) {
+				setFrameOffset(frame, out.size());
+				out.writeBytes(frames[frame].data(), frames[frame].size());
+				frames[frame] = {};
+			}
+			setFrameOffset(numFrames, out.size());
+			return;
+		}
+	}
+
+	for (size_t frame = 0; frame < numFrames; ++frame) {
+		setFrameOffset(frame, out.size());
+		encodeFrame(frame, out);
+	}
+	setFrameOffset(numFrames, out.size());
+}
+
+/**
+ * @brief Encodes the `numLines` lines of a frame, in bands on up to `numThreads` threads.
+ *
+ * `encodeLines(begin, end, writer, transparentRunWidth)` appends lines [begin, end)
+ * to `writer`. It continues the transparent run of `transparentRunWidth` pixels
+ * carried over from the previous line. It leaves the run carried over past the
+ * last line in `transparentRunWidth` without appending it.
+ *
+ * The carried transparent run is the only state shared between lines. Bands are
+ * therefore encoded independently, starting with no carried run. A band's leading
+ * transparent commands are then merged with the run carried over from the previous
+ * band, so the output is identical to the serial one.
+ */
+template <typename Out, typename EncodeLinesFn>
+void EncodeClxLines(size_t numLines, unsigned numThreads, Out &out, EncodeLinesFn &&encodeLines)
+{
+	// Bands smaller than this are not worth the overhead of a separate buffer.
+	constexpr size_t MinLinesPerBand = 32;
+	// More bands than threads balance out the uneven cost of the bands.
+	constexpr size_t BandsPerThread = 4;
+
+	if constexpr (std::is_same_v<Out, ClxWriter>) {
+		const size_t numBands = std::min(numLines / MinLinesPerBand,
+		    static_cast<size_t>(ResolveNumThreads(numThreads)) * BandsPerThread);
+		if (numThreads != 1 && numBands > 1) {
+			struct Band {
+				std::vector<uint8_t> data;
+				unsigned trailingTransparentRunWidth = 0;
+			};
+			std::vector<Band> bands(numBands);
+			ParallelFor(numBands, numThreads, [&](size_t i) {
+				ClxWriter bandOut { bands[i].data };
+				encodeLines(i * numLines / numBands, (i + 1) * numLines / numBands,
+				    bandOut, bands[i].trailingTransparentRunWidth);
+			});
+
+			unsigned transparentRunWidth = 0;
+			for (Band &band : bands) {
+				// A band that is entirely transparent has no commands.
+				if (band.data.empty()) {
+					transparentRunWidth += band.trailingTransparentRunWidth;
+					continue;
+				}
+				// Otherwise, it begins with zero or more transparent commands
+				// followed by a fill or pixels command.
+				const uint8_t *src = band.data.data();
+				const uint8_t *srcEnd = src + band.data.size();
+				for (; !IsClxOpaque(*src); ++src)
+					transparentRunWidth += *src;
+				AppendClxTransparentRun(transparentRunWidth, out);
+				out.reserve(srcEnd - src);
+				out.writeBytes(src, srcEnd - src);
+				transparentRunWidth = band.trailingTransparentRunWidth;
+				band.data = {};
+			}
+			AppendClxTransparentRun(transparentRunWidth, out);
+			return;
+		}
+	}
+
+	unsigned transparentRunWidth = 0;
+	encodeLines(0, numLines, out, transparentRunWidth);
+	AppendClxTransparentRun(transparentRunWidth, out);
+}
+
+} // namespace dvl_gfx
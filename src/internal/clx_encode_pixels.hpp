@@ -0,0 +1,184 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include <clx_encode.hpp>
+#include <dvl_gfx_common.hpp>
+
+#include "clx_encode_frames.hpp"
+
+namespace dvl_gfx {
+
+namespace detail {
+
+/**
+ * @brief Returns the first `p` in [src, end) such that `(*p == color) == Equal`, or `end`.
+ *
+ * Compares 32 (AVX2) or 16 (SSE2) pixels at a time and jumps straight to
+ * the first match with a count-trailing-zeros of the comparison mask,
+ * falling back to 8-byte words and then single bytes.
+ */
+template <bool Equal>
+const uint8_t *FindSpanEnd(const uint8_t *src, const uint8_t *end, uint8_t color)
+{
+#if defined(__AVX2__)
+	const __m256i needle32 = _mm256_set1_epi8(static_cast<char>(color));
+	while (end - src >= 32) {
+		auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+		    _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src)), needle32)));
+		if constexpr (!Equal)
+			mask = ~mask;
+		if (mask != 0)
+			return src + std::countr_zero(mask);
+		src += 32;
+	}
+#endif
+#if defined(__SSE2__)
+	const __m128i needle16 = _mm_set1_epi8(static_cast<char>(color));
+	while (end - src >= 16) {
+		auto mask = static_cast<uint32_t>(_mm_movemask_epi8(
+		    _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src)), needle16)));
+		if constexpr (!Equal)
+			mask = ~mask & 0xFFFF;
+		if (mask != 0)
+			return src + std::countr_zero(mask);
+		src += 16;
+	}
+#endif
+	if constexpr (std::endian::native == std::endian::little) {
+		constexpr uint64_t Low7Bits = 0x7F7F7F7F7F7F7F7FULL;
+		const uint64_t needle8 = color * 0x0101010101010101ULL;
+		while (end - src >= 8) {
+			uint64_t word;
+			std::memcpy(&word, src, 8);
+			const uint64_t diff = word ^ needle8;
+			// The high bit of each byte is set if and only if that byte of `diff` is non-zero.
+			uint64_t mask = (((diff & Low7Bits) + Low7Bits) | diff) & ~Low7Bits;
+			if constexpr (Equal)
+				mask = ~mask & ~Low7Bits;
+			if (mask != 0)
+				return src + std::countr_zero(mask) / 8;
+			src += 8;
+		}
+	}
+	while (src != end && (*src == color) != Equal)
+		++src;
+	return src;
+}
+
+/**
+ * @brief Encodes lines [line, lineEnd) of an 8-bit pixel buffer, bottom to top.
+ *
+ * Specialized on whether there is a transparent color and, for the most common
+ * sprite widths, on the width, so that the loops have no runtime mode checks
+ * and constant trip counts.
+ *
+ * @tparam FixedWidth The frame width, or 0 to use `width`.
+ */
+template <bool HasTransparency, unsigned FixedWidth, typename Out>
+void EncodeLines(const uint8_t *frameBuffer, size_t pitch, unsigned width, unsigned frameHeight,
+    uint8_t transparentColor, const ClxEncodeOptions &options,
+    size_t line, size_t lineEnd, Out &out, unsigned &transparentRunWidth)
+{
+	if constexpr (FixedWidth != 0)
+		width = FixedWidth;
+	for (; line != lineEnd; ++line) {
+		const uint8_t *src = &frameBuffer[(frameHeight - (line + 1)) * pitch];
+		if constexpr (!HasTransparency) {
+			AppendClxPixelsOrFillRun(src, width, out, options);
+		} else {
+			const uint8_t *const srcEnd = src + width;
+			while (true) {
+				const uint8_t *solidBegin = FindSpanEnd</*Equal=*/false>(src, srcEnd, transparentColor);
+				transparentRunWidth += static_cast<unsigned>(solidBegin - src);
+				if (solidBegin == srcEnd)
+					break;
+
+				const uint8_t *solidEnd = FindSpanEnd</*Equal=*/true>(solidBegin + 1, srcEnd, transparentColor);
+				AppendClxTransparentRun(transparentRunWidth, out);
+				transparentRunWidth = 0;
+				AppendClxPixelsOrFillRun(solidBegin, static_cast<unsigned>(solidEnd - solidBegin), out, options);
+				src = solidEnd;
+			}
+		}
+	}
+}
+
+template <bool HasTransparency, unsigned FixedWidth, typename Out>
+void EncodeFrameLines(const uint8_t *frameBuffer, size_t pitch, unsigned width, unsigned frameHeight,
+    uint8_t transparentColor, const ClxEncodeOptions &options, unsigned numThreads, Out &out)
+{
+	EncodeClxLines(frameHeight, numThreads, out,
+	    [&](size_t line, size_t lineEnd, auto &linesOut, unsigned &transparentRunWidth) {
+		    EncodeLines<HasTransparency, FixedWidth>(frameBuffer, pitch, width, frameHeight,
+		        transparentColor, options, line, lineEnd, linesOut, transparentRunWidth);
+	    });
+}
+
+template <bool HasTransparency, typename Out>
+void EncodeFrameLines(const uint8_t *frameBuffer, size_t pitch, unsigned width, unsigned frameHeight,
+    uint8_t transparentColor, const ClxEncodeOptions &options, unsigned numThreads, Out &out)
+{
+	switch (width) {
+	case 64:
+		EncodeFrameLines<HasTransparency, 64>(frameBuffer, pitch, width, frameHeight, transparentColor, options, numThreads, out);
+		break;
+	case 96:
+		EncodeFrameLines<HasTransparency, 96>(frameBuffer, pitch, width, frameHeight, transparentColor, options, numThreads, out);
+		break;
+	case 128:
+		EncodeFrameLines<HasTransparency, 128>(frameBuffer, pitch, width, frameHeight, transparentColor, options, numThreads, out);
+		break;
+	default:
+		EncodeFrameLines<HasTransparency, 0>(frameBuffer, pitch, width, frameHeight, transparentColor, options, numThreads, out);
+		break;
+	}
+}
+
+} // namespace detail
+
+/**
+ * @brief Encodes a CLX frame (header and pixel data) from an 8-bit pixel buffer.
+ *
+ * @param frameBuffer The top line of the frame.
+ * @param pitch Pixel buffer pitch, i.e. the width of each line including padding.
+ * @param width Frame width. May be less than `pitch`, in which case the rest of each line is ignored.
+ * @param frameHeight Frame height.
+ * @param transparentColor Palette index of the transparent color.
+ * @param numThreads The number of threads to encode bands of lines on.
+ */
+template <typename Out>
+void EncodeClxFrameFromPixels(const uint8_t *frameBuffer, size_t pitch, unsigned width, unsigned frameHeight,
+    std::optional<uint8_t> transparentColor, const ClxEncodeOptions &options, unsigned numThreads, Out &out)
+{
+	// Frame header: 5 16-bit values:
+	// 1. Offset to start of the pixel data.
+	// 2. Width
+	// 3. Height
+	// 4..5. Unused (0)
+	const size_t frameHeaderPos = out.appendZeros(ClxFrameHeaderSize);
+
+	// Frame header:
+	out.writeLE16At(frameHeaderPos, ClxFrameHeaderSize);
+	out.writeLE16At(frameHeaderPos + 2, static_cast<uint16_t>(width));
+	out.writeLE16At(frameHeaderPos + 4, static_cast<uint16_t>(frameHeight));
+
+	if (transparentColor.has_value()) {
+		detail::EncodeFrameLines<true>(
+		    frameBuffer, pitch, width, frameHeight, *transparentColor, options, numThreads, out);
+	} else {
+		detail::EncodeFrameLines<false>(
+		    frameBuffer, pitch, width, frameHeight, 0, options, numThreads, out);
+	}
+	InsertClxRowSkipTable(frameHeaderPos, frameHeight, options, out);
+}
+
+} // namespace dvl_gfx
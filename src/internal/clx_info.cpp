@@ -0,0 +1,270 @@
+#include <clx_info.hpp>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <clx_decode.hpp>
+#include <dvl_gfx_endian.hpp>
+
+namespace dvl_gfx {
+
+namespace {
+
+/**
+ * @brief Reads parts of a file with positioned reads, without reading the rest of it.
+ */
+class PositionedFileReader {
+public:
+	PositionedFileReader() = default;
+	PositionedFileReader(const PositionedFileReader &) = delete;
+	PositionedFileReader &operator=(const PositionedFileReader &) = delete;
+
+	~PositionedFileReader()
+	{
+#ifdef _WIN32
+		if (file_ != INVALID_HANDLE_VALUE)
+			CloseHandle(file_);
+#else
+		if (fd_ != -1)
+			::close(fd_);
+#endif
+	}
+
+	std::optional<IoError> open(const char *path)
+	{
+#ifdef _WIN32
+		file_ = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+		if (file_ == INVALID_HANDLE_VALUE)
+			return IoError { std::string("Failed to open input file: ").append(std::to_string(GetLastError())) };
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file_, &fileSize))
+			return IoError { std::string("Failed to get input file size: ").append(std::to_string(GetLastError())) };
+		size_ = static_cast<uint64_t>(fileSize.QuadPart);
+#else
+		fd_ = ::open(path, O_RDONLY | O_CLOEXEC);
+		if (fd_ == -1)
+			return IoError { std::string("Failed to open input file: ").append(std::strerror(errno)) };
+		struct stat fileStat;
+		if (fstat(fd_, &fileStat) == -1)
+			return IoError { std::string("Failed to get input file size: ").append(std::strerror(errno)) };
+		size_ = static_cast<uint64_t>(fileStat.st_size);
+#ifdef POSIX_FADV_RANDOM
+		// Only a few small parts of the file are read, so reading ahead would only waste I/O.
+		posix_fadvise(fd_, 0, 0, POSIX_FADV_RANDOM);
+#endif
+#endif
+		return std::nullopt;
+	}
+
+	[[nodiscard]] uint64_t size() const
+	{
+		return size_;
+	}
+
+	/**
+	 * @brief Reads `[offset, offset + length)`, which must lie within the file.
+	 */
+	std::optional<IoError> read(uint64_t offset, size_t length, uint8_t *out)
+	{
+		while (length != 0) {
+#ifdef _WIN32
+			OVERLAPPED overlapped {};
+			overlapped.Offset = static_cast<DWORD>(offset);
+			overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+			DWORD n;
+			if (!ReadFile(file_, out, static_cast<DWORD>(length), &n, &overlapped))
+				return IoError { std::string("Failed to read input file: ").append(std::to_string(GetLastError())) };
+#else
+			const ssize_t n = pread(fd_, out, length, static_cast<off_t>(offset));
+			if (n == -1) {
+				if (errno == EINTR)
+					continue;
+				return IoError { std::string("Failed to read input file: ").append(std::strerror(errno)) };
+			}
+#endif
+			if (n == 0)
+				return IoError { "Unexpected end of input file" };
+			offset += static_cast<size_t>(n);
+			length -= static_cast<size_t>(n);
+			out += n;
+		}
+		return std::nullopt;
+	}
+
+	std::optional<IoError> read32(uint64_t offset, uint32_t &value)
+	{
+		std::array<uint8_t, 4> bytes;
+		if (std::optional<IoError> error = read(offset, bytes.size(), bytes.data()); error.has_value())
+			return error;
+		value = LoadLE32(bytes.data());
+		return std::nullopt;
+	}
+
+private:
+#ifdef _WIN32
+	HANDLE file_ = INVALID_HANDLE_VALUE;
+#else
+	int fd_ = -1;
+#endif
+	uint64_t size_ = 0;
+};
+
+/**
+ * @brief The headers of frames this close together are fetched with a single read.
+ * Reading a few more bytes costs less than another read.
+ */
+constexpr uint32_t MaxHeaderReadSize = 4096;
+
+/**
+ * @brief Reads the frame offset table and the frame headers of the list at `[begin, end)`,
+ * validating the offset table like `ValidateClxListOffsets`.
+ */
+std::optional<IoError> ReadClxListInfo(PositionedFileReader &reader, uint32_t begin, uint32_t end,
+    std::vector<uint8_t> &buffer, ClxListInfo &list)
+{
+	list.offset = begin;
+	list.size = end - begin;
+	list.frames.clear();
+	if (list.size < 4)
+		return IoError { "CLX list too small" };
+	uint32_t numSprites;
+	if (std::optional<IoError> error = reader.read32(begin, numSprites); error.has_value())
+		return error;
+	const uint64_t offsetTableEnd = 4 + 4 * (static_cast<uint64_t>(numSprites) + 1);
+	if (offsetTableEnd > list.size)
+		return IoError { "CLX list frame offset table out of bounds" };
+	buffer.resize(4 * (static_cast<size_t>(numSprites) + 1));
+	if (std::optional<IoError> error = reader.read(begin + 4, buffer.size(), buffer.data()); error.has_value())
+		return error;
+
+	uint64_t prevOffset = offsetTableEnd;
+	for (size_t i = 0; i <= numSprites; ++i) {
+		const uint32_t offset = LoadLE32(&buffer[4 * i]);
+		if (offset > list.size)
+			return IoError { std::string("CLX frame offset out of bounds: ").append(std::to_string(i)) };
+		if (i != 0 && offset < prevOffset + ClxFrameHeaderSize)
+			return IoError { std::string("CLX frame too small: ").append(std::to_string(i - 1)) };
+		if (i == 0 && offset < prevOffset)
+			return IoError { "CLX frame overlaps the frame offset table" };
+		prevOffset = offset;
+	}
+
+	list.frames.reserve(numSprites);
+	std::vector<uint8_t> headers;
+	for (size_t i = 0; i < numSprites;) {
+		// Read the headers of the frames that start within `MaxHeaderReadSize` bytes of frame `i` at once.
+		const uint32_t readBegin = LoadLE32(&buffer[4 * i]);
+		size_t readEndFrame = i + 1;
+		while (readEndFrame < numSprites && LoadLE32(&buffer[4 * readEndFrame]) + ClxFrameHeaderSize - readBegin <= MaxHeaderReadSize)
+			++readEndFrame;
+		headers.resize(LoadLE32(&buffer[4 * (readEndFrame - 1)]) + ClxFrameHeaderSize - readBegin);
+		if (std::optional<IoError> error = reader.read(begin + readBegin, headers.size(), headers.data()); error.has_value())
+			return error;
+		for (; i < readEndFrame; ++i) {
+			const uint32_t offset = LoadLE32(&buffer[4 * i]);
+			const uint8_t *header = &headers[offset - readBegin];
+			list.frames.push_back(ClxFrameInfo {
+			    GetClxSpriteWidth(header),
+			    GetClxSpriteHeight(header),
+			    LoadLE16(header),
+			    LoadLE32(&buffer[4 * (i + 1)]) - offset,
+			});
+		}
+	}
+	return std::nullopt;
+}
+
+} // namespace
+
+Size ClxListInfo::verticallyStackedSize() const
+{
+	Size result { 0, 0 };
+	for (const ClxFrameInfo &frame : frames) {
+		result.width = std::max<uint32_t>(result.width, frame.width);
+		result.height += frame.height;
+	}
+	return result;
+}
+
+std::optional<IoError> ReadClxInfo(const char *path, ClxInfo &info)
+{
+	info.fileSize = 0;
+	info.isSheet = false;
+	info.lists.clear();
+
+	PositionedFileReader reader;
+	if (std::optional<IoError> error = reader.open(path); error.has_value())
+		return error;
+	const uint64_t size = reader.size();
+	info.fileSize = size;
+	if (size < 4)
+		return IoError { "CLX data too small" };
+	if (size > std::numeric_limits<uint32_t>::max())
+		return IoError { "CLX data too large" };
+
+	// Tell lists and sheets apart like `GetNumListsFromClxListOrSheetBuffer`:
+	// the last frame offset of a CLX list is the size of the file.
+	uint32_t first;
+	if (std::optional<IoError> error = reader.read32(0, first); error.has_value())
+		return error;
+	// A first word under 4 is zero lists, i.e. a CLX list.
+	bool isList = first / 4 == 0;
+	if (const uint64_t lastFrameOffsetPos = 4 + 4 * static_cast<uint64_t>(first); !isList && lastFrameOffsetPos + 4 <= size) {
+		uint32_t lastFrameOffset;
+		if (std::optional<IoError> error = reader.read32(lastFrameOffsetPos, lastFrameOffset); error.has_value())
+			return error;
+		isList = lastFrameOffset == size;
+	}
+
+	std::vector<uint8_t> buffer;
+	if (isList) {
+		info.lists.resize(1);
+		return ReadClxListInfo(reader, 0, static_cast<uint32_t>(size), buffer, info.lists[0]);
+	}
+
+	// A CLX sheet starts with the offsets of its lists, the first of which is the size of that table.
+	const uint32_t listOffsetsSize = first;
+	if (listOffsetsSize == 0 || listOffsetsSize % 4 != 0 || listOffsetsSize > size)
+		return IoError { "Not a CLX list or sheet: invalid list offset table" };
+	info.isSheet = true;
+	const size_t numLists = listOffsetsSize / 4;
+	std::vector<uint8_t> listOffsets(listOffsetsSize);
+	if (std::optional<IoError> error = reader.read(0, listOffsets.size(), listOffsets.data()); error.has_value())
+		return error;
+	for (size_t i = 0; i < numLists; ++i) {
+		const uint32_t begin = LoadLE32(&listOffsets[4 * i]);
+		// The last list extends to the end of the sheet.
+		const uint32_t end = i + 1 < numLists ? LoadLE32(&listOffsets[4 * (i + 1)]) : static_cast<uint32_t>(size);
+		if (begin < listOffsetsSize || begin > end || end > size)
+			return IoError { std::string("CLX list offset out of bounds: ").append(std::to_string(i)) };
+	}
+	info.lists.resize(numLists);
+	for (size_t i = 0; i < numLists; ++i) {
+		const uint32_t begin = LoadLE32(&listOffsets[4 * i]);
+		const uint32_t end = i + 1 < numLists ? LoadLE32(&listOffsets[4 * (i + 1)]) : static_cast<uint32_t>(size);
+		if (std::optional<IoError> error = ReadClxListInfo(reader, begin, end, buffer, info.lists[i]); error.has_value()) {
+			error->message.append(" in list ").append(std::to_string(i));
+			return error;
+		}
+	}
+	return std::nullopt;
+}
+
+} // namespace dvl_gfx
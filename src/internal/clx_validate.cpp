@@ -0,0 +1,131 @@
+#include <clx_validate.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <span>
+#include <string>
+#include <vector>
+
+#include "clx_container.hpp"
+#include "clx_decode.hpp"
+
+namespace dvl_gfx {
+
+std::optional<IoError> ValidateClxSprite(std::span<const uint8_t> clxSprite, ClxSpriteProperties *outProperties)
+{
+	if (clxSprite.size() < ClxFrameHeaderSize)
+		return IoError { "CLX frame too small" };
+	const uint8_t *sprite = clxSprite.data();
+	const uint16_t headerSize = LoadLE16(sprite);
+	if (headerSize < ClxFrameHeaderSize || headerSize > clxSprite.size())
+		return IoError { std::string("CLX frame header size out of bounds: ").append(std::to_string(headerSize)) };
+	const unsigned width = GetClxSpriteWidth(sprite);
+	const unsigned height = GetClxSpriteHeight(sprite);
+	const uint64_t numPixels = static_cast<uint64_t>(width) * height;
+
+	// The row-skip table, if any, must match the positions found by walking the commands.
+	const uint16_t rowSkipInterval = GetClxSpriteRowSkipInterval(sprite);
+	const size_t numRowSkipEntries = rowSkipInterval == 0 ? 0 : (height - 1) / rowSkipInterval;
+	const uint64_t rowSkipEntryPixels = static_cast<uint64_t>(rowSkipInterval) * width;
+	size_t nextEntry = 0;
+	uint64_t nextEntryPos = numRowSkipEntries == 0 ? UINT64_MAX : rowSkipEntryPixels;
+
+	ClxSpriteProperties properties;
+	properties.opaqueCommandsWithinLines = true;
+	properties.commandsWithinLines = true;
+	properties.hasRowSkipTable = rowSkipInterval != 0;
+
+	const uint8_t *src = sprite + headerSize;
+	const uint8_t *const srcEnd = sprite + clxSprite.size();
+	// The number of pixels covered by the commands so far, and the pixel of the line that the next command begins at.
+	uint64_t pos = 0;
+	unsigned x = 0;
+	bool lastCommandEmpty = false;
+	while (src != srcEnd) {
+		// Decoding the control byte arithmetically rather than with `ClxControlTable` keeps
+		// a table load out of the chain of dependent loads from one command to the next.
+		const uint8_t control = *src;
+		ClxControlInfo info;
+		if (!IsClxOpaque(control)) {
+			info = { ClxBlitType::Transparent, control, 1 };
+		} else if (IsClxOpaqueFill(control)) {
+			info = { ClxBlitType::Fill, static_cast<uint8_t>(GetClxOpaqueFillWidth(control)), 2 };
+		} else {
+			const auto width = static_cast<uint8_t>(GetClxOpaquePixelsWidth(control));
+			info = { ClxBlitType::Pixels, width, static_cast<uint8_t>(1 + width) };
+		}
+		if (info.srcAdvance > srcEnd - src)
+			return IoError { std::string("CLX command out of bounds at offset ").append(std::to_string(src - sprite)) };
+		// A transparent run can span several entries of a narrow sprite.
+		while (pos + info.length > nextEntryPos) [[unlikely]] {
+			const uint32_t offset = LoadLE32(&sprite[ClxExtendedFrameHeaderSize + 4 * nextEntry]);
+			const uint8_t skip = sprite[ClxExtendedFrameHeaderSize + 4 * numRowSkipEntries + nextEntry];
+			if (offset != static_cast<size_t>(src - sprite) || skip != nextEntryPos - pos)
+				return IoError { std::string("CLX row-skip table entry does not match the pixel data: ").append(std::to_string(nextEntry)) };
+			++nextEntry;
+			nextEntryPos = nextEntry == numRowSkipEntries ? UINT64_MAX : nextEntryPos + rowSkipEntryPixels;
+		}
+		pos += info.length;
+		src += info.srcAdvance;
+		lastCommandEmpty = info.length == 0;
+		x += info.length;
+		if (x >= width) {
+			if (x > width) {
+				properties.commandsWithinLines = false;
+				if (info.type != ClxBlitType::Transparent)
+					properties.opaqueCommandsWithinLines = false;
+			}
+			if (width != 0) {
+				x -= width;
+				if (x >= width) [[unlikely]]
+					x %= width;
+			}
+		}
+	}
+	if (pos > numPixels)
+		return IoError { "CLX commands cover more than width x height pixels" };
+	// The decoders only check for the end of the pixel data at the end of a line.
+	// An empty command at the start of a line begins that line, unless there is nothing left to draw.
+	if (x != 0 || (lastCommandEmpty && pos < numPixels))
+		return IoError { "CLX commands end in the middle of a line" };
+	if (nextEntry != numRowSkipEntries)
+		return IoError { std::string("CLX row-skip table entry past the end of the pixel data: ").append(std::to_string(nextEntry)) };
+	properties.coversAllPixels = pos == numPixels;
+	if (outProperties != nullptr)
+		*outProperties = properties;
+	return std::nullopt;
+}
+
+std::optional<IoError> ValidateClx(std::span<const uint8_t> clxData, std::vector<ClxSpriteProperties> *outSprites)
+{
+	std::vector<std::span<const uint8_t>> lists;
+	bool isSheet = false;
+	if (std::optional<IoError> error = SplitClxListOrSheet(clxData, lists, isSheet); error.has_value())
+		return error;
+	if (outSprites != nullptr)
+		outSprites->clear();
+
+	for (size_t i = 0; i < lists.size(); ++i) {
+		const std::span<const uint8_t> clxList = lists[i];
+		std::optional<IoError> error = ValidateClxListOffsets(clxList);
+		const uint32_t numSprites = error.has_value() ? 0 : GetNumSpritesFromClxList(clxList.data());
+		for (uint32_t j = 0; j < numSprites && !error.has_value(); ++j) {
+			ClxSpriteProperties properties;
+			error = ValidateClxSprite(GetSpriteDataFromClxList(clxList.data(), j), &properties);
+			if (error.has_value()) {
+				error->message.append(" in frame ").append(std::to_string(j));
+			} else if (outSprites != nullptr) {
+				outSprites->push_back(properties);
+			}
+		}
+		if (error.has_value()) {
+			if (isSheet)
+				error->message.append(" in list ").append(std::to_string(i));
+			return error;
+		}
+	}
+	return std::nullopt;
+}
+
+} // namespace dvl_gfx
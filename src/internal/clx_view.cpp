@@ -0,0 +1,168 @@
+#include <clx_view.hpp>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <clx2pixels.hpp>
+
+#include "clx_container.hpp"
+
+namespace dvl_gfx {
+
+ClxView::ClxView(ClxView &&other) noexcept
+    : data_(std::exchange(other.data_, {}))
+    , lists_(std::exchange(other.lists_, {}))
+    , isSheet_(std::exchange(other.isSheet_, false))
+    , mapping_(std::exchange(other.mapping_, nullptr))
+    , mappingSize_(std::exchange(other.mappingSize_, 0))
+{
+}
+
+ClxView &ClxView::operator=(ClxView &&other) noexcept
+{
+	if (this != &other) {
+		close();
+		data_ = std::exchange(other.data_, {});
+		lists_ = std::exchange(other.lists_, {});
+		isSheet_ = std::exchange(other.isSheet_, false);
+		mapping_ = std::exchange(other.mapping_, nullptr);
+		mappingSize_ = std::exchange(other.mappingSize_, 0);
+	}
+	return *this;
+}
+
+ClxView::~ClxView()
+{
+	close();
+}
+
+void ClxView::close()
+{
+	if (mapping_ != nullptr) {
+#ifdef _WIN32
+		UnmapViewOfFile(mapping_);
+#else
+		munmap(mapping_, mappingSize_);
+#endif
+		mapping_ = nullptr;
+		mappingSize_ = 0;
+	}
+	data_ = {};
+	lists_.clear();
+	isSheet_ = false;
+}
+
+std::optional<IoError> ClxView::open(const char *path)
+{
+	close();
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return IoError { std::string("Failed to open input file: ").append(std::to_string(GetLastError())) };
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize)) {
+		CloseHandle(file);
+		return IoError { std::string("Failed to get input file size: ").append(std::to_string(GetLastError())) };
+	}
+	if (fileSize.QuadPart < 4) {
+		CloseHandle(file);
+		return IoError { "CLX data too small" };
+	}
+	// The view keeps the file mapping alive, so the handles are not needed past this point.
+	HANDLE mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(file);
+	if (mappingHandle == nullptr)
+		return IoError { std::string("Failed to map input file: ").append(std::to_string(GetLastError())) };
+	void *mapping = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mappingHandle);
+	if (mapping == nullptr)
+		return IoError { std::string("Failed to map input file: ").append(std::to_string(GetLastError())) };
+	const auto size = static_cast<size_t>(fileSize.QuadPart);
+#else
+	const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return IoError { std::string("Failed to open input file: ").append(std::strerror(errno)) };
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) == -1) {
+		const int error = errno;
+		::close(fd);
+		return IoError { std::string("Failed to get input file size: ").append(std::strerror(error)) };
+	}
+	if (fileStat.st_size < 4) {
+		::close(fd);
+		return IoError { "CLX data too small" };
+	}
+	const auto size = static_cast<size_t>(fileStat.st_size);
+	// The mapping keeps the file open, so the descriptor is not needed past this point.
+	void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	const int error = errno;
+	::close(fd);
+	if (mapping == MAP_FAILED)
+		return IoError { std::string("Failed to map input file: ").append(std::strerror(error)) };
+#endif
+
+	if (std::optional<IoError> result = open(std::span<const uint8_t>(static_cast<const uint8_t *>(mapping), size));
+	    result.has_value()) {
+#ifdef _WIN32
+		UnmapViewOfFile(mapping);
+#else
+		munmap(mapping, size);
+#endif
+		return result;
+	}
+	mapping_ = mapping;
+	mappingSize_ = size;
+	return std::nullopt;
+}
+
+std::optional<IoError> ClxView::open(std::span<const uint8_t> clxData)
+{
+	close();
+	std::vector<std::span<const uint8_t>> lists;
+	bool isSheet = false;
+	if (std::optional<IoError> error = SplitClxListOrSheet(clxData, lists, isSheet); error.has_value())
+		return error;
+
+	for (size_t i = 0; i < lists.size(); ++i) {
+		if (std::optional<IoError> error = ValidateClxListOffsets(lists[i]); error.has_value()) {
+			if (isSheet)
+				error->message.append(" in list ").append(std::to_string(i));
+			return error;
+		}
+	}
+
+	data_ = clxData;
+	lists_ = std::move(lists);
+	isSheet_ = isSheet;
+	return std::nullopt;
+}
+
+std::optional<IoError> ClxView::decodeSprite(size_t listIndex, size_t spriteIndex, uint8_t *dst, unsigned pitch) const
+{
+	if (listIndex >= lists_.size())
+		return IoError { std::string("CLX list index out of bounds: ").append(std::to_string(listIndex)) };
+	const ClxListView clxList = list(listIndex);
+	if (spriteIndex >= clxList.numSprites())
+		return IoError { std::string("CLX frame index out of bounds: ").append(std::to_string(spriteIndex)) };
+	const ClxSpriteView sprite = clxList.sprite(spriteIndex);
+	const uint16_t headerSize = LoadLE16(sprite.data().data());
+	if (headerSize < ClxFrameHeaderSize || headerSize > sprite.data().size())
+		return IoError { std::string("CLX frame header size out of bounds: ").append(std::to_string(headerSize)) };
+	ClxSprite2Pixels(sprite.data(), dst, pitch);
+	return std::nullopt;
+}
+
+} // namespace dvl_gfx
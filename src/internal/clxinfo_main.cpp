@@ -0,0 +1,249 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include <algorithm>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <clx_info.hpp>
+#include <dvl_gfx_common.hpp>
+
+#include "argument_parser.hpp"
+#include "parallel_for.hpp"
+#include "tl/expected.hpp"
+
+namespace dvl_gfx {
+namespace {
+
+constexpr char KHelp[] = R"(Usage: clxinfo [options] files...
+
+Prints the lists, frames, frame dimensions and frame sizes of CLX files.
+Only the offset tables and frame headers are read, not the pixel data.
+
+Options:
+  --format <arg>               tsv or json. Default: tsv.
+  --summary                    Print one entry per list rather than per frame: the number
+                               of frames and the size of the frames stacked vertically.
+  -j, --jobs <arg>             Number of files to read at a time, 0 for one per CPU core. Default: 1.
+
+Files that are not valid CLX are reported on stderr and skipped.
+)";
+
+enum class OutputFormat : uint8_t {
+	Tsv,
+	Json,
+};
+
+struct Options {
+	std::vector<const char *> inputPaths;
+	OutputFormat format = OutputFormat::Tsv;
+	bool summary = false;
+	unsigned numThreads = 1;
+};
+
+void PrintHelp()
+{
+	std::cerr << KHelp << std::endl;
+}
+
+tl::expected<Options, ArgumentError> ParseArguments(int argc, char *argv[])
+{
+	if (argc == 1) {
+		PrintHelp();
+		std::exit(64);
+	}
+	Options options;
+	ArgumentParserState state { 1, argc, argv };
+	for (; !state.atEnd(); ++state.pos) {
+		const std::string_view arg = state.arg();
+		if (arg == "-h" || arg == "--help") {
+			PrintHelp();
+			std::exit(0);
+		}
+		if (arg == "--format") {
+			tl::expected<std::string_view, ArgumentError> value = ParseArgumentValue(state);
+			if (!value.has_value())
+				return tl::unexpected { std::move(value).error() };
+			if (*value == "tsv") {
+				options.format = OutputFormat::Tsv;
+			} else if (*value == "json") {
+				options.format = OutputFormat::Json;
+			} else {
+				return tl::unexpected { ArgumentError { "--format", "must be tsv or json" } };
+			}
+		} else if (arg == "--summary") {
+			options.summary = true;
+		} else if (arg == "-j" || arg == "--jobs") {
+			tl::expected<unsigned, ArgumentError> value = ParseIntArgument<unsigned>(state);
+			if (!value.has_value())
+				return tl::unexpected { std::move(value).error() };
+			options.numThreads = *value;
+		} else if (arg.empty() || arg[0] == '-') {
+			return tl::unexpected { ArgumentError { arg, "unknown argument" } };
+		} else {
+			break;
+		}
+	}
+	if (std::optional<ArgumentError> error = ParsePositionalArguments(state, "files...", options.inputPaths);
+	    error.has_value()) {
+		return tl::unexpected { *std::move(error) };
+	}
+	return options;
+}
+
+void AppendJsonString(std::string_view str, std::string &out)
+{
+	out += '"';
+	for (const char c : str) {
+		if (c == '"' || c == '\\') {
+			out += '\\';
+			out += c;
+		} else if (static_cast<unsigned char>(c) < 0x20) {
+			char escaped[7];
+			std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(c));
+			out += escaped;
+		} else {
+			out += c;
+		}
+	}
+	out += '"';
+}
+
+void AppendTsv(const char *path, const ClxInfo &info, bool summary, std::string &out)
+{
+	for (size_t i = 0; i < info.lists.size(); ++i) {
+		const ClxListInfo &list = info.lists[i];
+		if (summary) {
+			const Size size = list.verticallyStackedSize();
+			out.append(path).append("\t").append(std::to_string(i))
+			    .append("\t").append(std::to_string(list.frames.size()))
+			    .append("\t").append(std::to_string(size.width))
+			    .append("\t").append(std::to_string(size.height))
+			    .append("\t").append(std::to_string(list.size))
+			    .append("\n");
+			continue;
+		}
+		for (size_t j = 0; j < list.frames.size(); ++j) {
+			const ClxFrameInfo &frame = list.frames[j];
+			out.append(path).append("\t").append(std::to_string(i))
+			    .append("\t").append(std::to_string(j))
+			    .append("\t").append(std::to_string(frame.width))
+			    .append("\t").append(std::to_string(frame.height))
+			    .append("\t").append(std::to_string(frame.headerSize))
+			    .append("\t").append(std::to_string(frame.size))
+			    .append("\n");
+		}
+	}
+}
+
+void AppendJson(const char *path, const ClxInfo &info, bool summary, std::string &out)
+{
+	out.append("{\"file\": ");
+	AppendJsonString(path, out);
+	out.append(", \"size\": ").append(std::to_string(info.fileSize));
+	out.append(", \"sheet\": ").append(info.isSheet ? "true" : "false");
+	out.append(", \"lists\": [");
+	for (size_t i = 0; i < info.lists.size(); ++i) {
+		const ClxListInfo &list = info.lists[i];
+		const Size size = list.verticallyStackedSize();
+		if (i != 0)
+			out.append(", ");
+		out.append("{\"offset\": ").append(std::to_string(list.offset))
+		    .append(", \"size\": ").append(std::to_string(list.size))
+		    .append(", \"numFrames\": ").append(std::to_string(list.frames.size()))
+		    .append(", \"width\": ").append(std::to_string(size.width))
+		    .append(", \"height\": ").append(std::to_string(size.height));
+		if (!summary) {
+			out.append(", \"frames\": [");
+			for (size_t j = 0; j < list.frames.size(); ++j) {
+				const ClxFrameInfo &frame = list.frames[j];
+				if (j != 0)
+					out.append(", ");
+				out.append("{\"width\": ").append(std::to_string(frame.width))
+				    .append(", \"height\": ").append(std::to_string(frame.height))
+				    .append(", \"headerSize\": ").append(std::to_string(frame.headerSize))
+				    .append(", \"size\": ").append(std::to_string(frame.size))
+				    .append("}");
+			}
+			out.append("]");
+		}
+		out.append("}");
+	}
+	out.append("]}");
+}
+
+struct FileResult {
+	ClxInfo info;
+	std::optional<IoError> error;
+};
+
+/**
+ * @brief Prints the metadata of all the files, reading up to `numThreads` files at a time.
+ *
+ * @return Whether every file was read successfully.
+ */
+bool Run(const Options &options)
+{
+	// Read the files in batches, so that the output is in order and streamed
+	// without keeping the metadata of all the files in memory.
+	constexpr size_t BatchSize = 256;
+	std::vector<FileResult> results;
+	std::string out;
+	bool success = true;
+	bool firstJsonEntry = true;
+
+	if (options.format == OutputFormat::Tsv) {
+		std::cout << (options.summary ? "file\tlist\tframes\twidth\theight\tbytes\n"
+		                              : "file\tlist\tframe\twidth\theight\theader\tbytes\n");
+	} else {
+		std::cout << "[";
+	}
+	for (size_t batchBegin = 0; batchBegin < options.inputPaths.size(); batchBegin += BatchSize) {
+		const size_t batchSize = std::min(BatchSize, options.inputPaths.size() - batchBegin);
+		results.resize(batchSize);
+		ParallelFor(batchSize, options.numThreads, [&](size_t i) {
+			results[i].error = ReadClxInfo(options.inputPaths[batchBegin + i], results[i].info);
+		});
+		out.clear();
+		for (size_t i = 0; i < batchSize; ++i) {
+			const char *inputPath = options.inputPaths[batchBegin + i];
+			if (results[i].error.has_value()) {
+				std::cerr << results[i].error->message << ": " << inputPath << std::endl;
+				success = false;
+				continue;
+			}
+			if (options.format == OutputFormat::Tsv) {
+				AppendTsv(inputPath, results[i].info, options.summary, out);
+			} else {
+				out.append(firstJsonEntry ? "\n" : ",\n");
+				firstJsonEntry = false;
+				AppendJson(inputPath, results[i].info, options.summary, out);
+			}
+		}
+		std::cout << out;
+	}
+	if (options.format == OutputFormat::Json)
+		std::cout << "\n]\n";
+	std::cout.flush();
+	return success;
+}
+
+} // namespace
+} // namespace dvl_gfx
+
+int main(int argc, char *argv[])
+{
+	tl::expected<dvl_gfx::Options, dvl_gfx::ArgumentError> options = dvl_gfx::ParseArguments(argc, argv);
+	if (!options) {
+		std::cerr << options.error().arg << ": " << options.error().error
+		          << std::endl;
+		return 64;
+	}
+	return dvl_gfx::Run(*options) ? 0 : 1;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <optional>
+#include <string_view>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+// Kernels are compiled for several instruction sets and picked at runtime.
+#define DVL_GFX_X86_DISPATCH 1
+#define DVL_GFX_TARGET_SSE42 __attribute__((target("sse4.2,popcnt")))
+#define DVL_GFX_TARGET_AVX2 __attribute__((target("avx2,bmi,bmi2,popcnt")))
+#define DVL_GFX_TARGET_AVX512 __attribute__((target("avx512f,avx512bw,avx2,bmi,bmi2,popcnt")))
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define DVL_GFX_ALWAYS_INLINE [[gnu::always_inline]] inline
+#else
+#define DVL_GFX_ALWAYS_INLINE inline
+#endif
+
+namespace dvl_gfx {
+
+/**
+ * @brief Instruction set variants of the hot kernels, in increasing order.
+ */
+enum class CpuIsa : uint8_t {
+	Scalar,
+	Sse42,
+	Avx2,
+	Avx512,
+};
+
+/**
+ * @brief Parses an instruction set name: "scalar", "sse4.2", "avx2" or "avx512".
+ */
+inline std::optional<CpuIsa> ParseCpuIsa(std::string_view name)
+{
+	if (name == "scalar")
+		return CpuIsa::Scalar;
+	if (name == "sse4.2" || name == "sse42")
+		return CpuIsa::Sse42;
+	if (name == "avx2")
+		return CpuIsa::Avx2;
+	if (name == "avx512")
+		return CpuIsa::Avx512;
+	return std::nullopt;
+}
+
+/**
+ * @brief The best instruction set supported by this CPU (and OS).
+ */
+inline CpuIsa DetectCpuIsa()
+{
+#ifdef DVL_GFX_X86_DISPATCH
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")
+	    && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2"))
+		return CpuIsa::Avx512;
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2"))
+		return CpuIsa::Avx2;
+	if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt"))
+		return CpuIsa::Sse42;
+#endif
+	return CpuIsa::Scalar;
+}
+
+/**
+ * @brief The instruction set variant of the hot kernels to use.
+ *
+ * Determined once, on first use. The `DVL_GFX_FORCE_ISA` environment variable
+ * (see `ParseCpuIsa`) pins a variant, e.g. for benchmarking. A variant that the
+ * CPU does not support is lowered to the best one that it does.
+ */
+inline CpuIsa GetCpuIsa()
+{
+	static const CpuIsa isa = []() {
+		const CpuIsa detected = DetectCpuIsa();
+		const char *forced = std::getenv("DVL_GFX_FORCE_ISA");
+		if (forced == nullptr)
+			return detected;
+		const std::optional<CpuIsa> parsed = ParseCpuIsa(forced);
+		if (!parsed.has_value())
+			return detected;
+		return *parsed < detected ? *parsed : detected;
+	}();
+	return isa;
+}
+
+} // namespace dvl_gfx
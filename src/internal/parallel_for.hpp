@@ -0,0 +1,53 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace dvl_gfx {
+
+/**
+ * @brief Resolves a requested thread count, where 0 means one thread per hardware thread.
+ */
+inline unsigned ResolveNumThreads(unsigned numThreads)
+{
+	if (numThreads != 0)
+		return numThreads;
+	return std::max(1U, std::thread::hardware_concurrency());
+}
+
+/**
+ * @brief Calls `fn(i)` for every `i` in [0, n) on up to `numThreads` threads.
+ *
+ * The calling thread takes part in the work. Indices are handed out in
+ * increasing order, one at a time, so uneven work items balance out.
+ */
+template <typename F>
+void ParallelFor(size_t n, unsigned numThreads, F &&fn)
+{
+	numThreads = static_cast<unsigned>(std::min<size_t>(ResolveNumThreads(numThreads), n));
+	if (numThreads <= 1) {
+		for (size_t i = 0; i < n; ++i)
+			fn(i);
+		return;
+	}
+
+	std::atomic<size_t> next { 0 };
+	const auto worker = [&]() {
+		for (size_t i = next.fetch_add(1, std::memory_order_relaxed); i < n;
+		     i = next.fetch_add(1, std::memory_order_relaxed)) {
+			fn(i);
+		}
+	};
+	std::vector<std::thread> threads;
+	threads.reserve(numThreads - 1);
+	for (unsigned i = 1; i < numThreads; ++i)
+		threads.emplace_back(worker);
+	worker();
+	for (std::thread &thread : threads)
+		thread.join();
+}
+
+} // namespace dvl_gfx
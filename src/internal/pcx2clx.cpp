@@ -1,6 +1,7 @@
 #include <pcx2clx.hpp>
 
 #include <array>
+#include <bit>
 #include <cassert>
 #include <cerrno>
 #include <cstdint>
@@ -8,139 +9,298 @@
 #include <filesystem>
 #include <fstream>
 #include <memory>
+#include <type_traits>
 #include <vector>
 
 #include <dvl_gfx_endian.hpp>
 
 #include "clx_encode.hpp"
+#include "clx_encode_frames.hpp"
+#include "clx_encode_pixels.hpp"
+#include "cpu_dispatch.hpp"
+#include "parallel_for.hpp"
 #include "pcx.hpp"
 
+#ifdef DVL_GFX_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
 namespace dvl_gfx {
 
-std::optional<IoError> PcxToClx(const uint8_t *data, size_t size,
-    int numFramesOrFrameHeight,
-    std::optional<uint8_t> transparentColor,
-    const std::vector<uint16_t> &cropWidths,
-    std::vector<uint8_t> &clxData,
-    uint8_t *paletteData)
-{
+namespace {
+
+struct PcxFrames {
+	const uint8_t *pixelData;
+	const uint8_t *dataEnd;
 	int width;
+	unsigned frameHeight;
+	unsigned numFrames;
+};
+
+std::optional<IoError> LoadPcxFrames(const uint8_t *data, size_t size,
+    int numFramesOrFrameHeight, PcxFrames &frames)
+{
 	int height;
 	uint8_t bpp;
 	if (size < PcxHeaderSize) {
 		return IoError { "data too small" };
 	}
-	const uint8_t *pixelData = LoadPcxMeta(data, width, height, bpp);
-	const size_t pixelDataSize = size - PcxHeaderSize;
+	frames.pixelData = LoadPcxMeta(data, frames.width, height, bpp);
+	frames.dataEnd = data + size;
 	assert(bpp == 8);
 
-	unsigned numFrames;
-	unsigned frameHeight;
 	if (numFramesOrFrameHeight > 0) {
-		numFrames = numFramesOrFrameHeight;
-		frameHeight = height / numFrames;
+		frames.numFrames = numFramesOrFrameHeight;
+		frames.frameHeight = height / frames.numFrames;
 	} else {
-		frameHeight = -numFramesOrFrameHeight;
-		numFrames = height / frameHeight;
+		frames.frameHeight = -numFramesOrFrameHeight;
+		frames.numFrames = height / frames.frameHeight;
 	}
+	return std::nullopt;
+}
 
-	// CLX header: frame count, frame offset for each frame, file size
-	clxData.reserve(pixelDataSize);
-	clxData.resize(4 * (2 + static_cast<size_t>(numFrames)));
-	WriteLE32(clxData.data(), numFrames);
+#ifdef DVL_GFX_X86_DISPATCH
+// Each of these copies a vector of PCX data to `dst` (unless it is null) and
+// returns the number of leading bytes that are single pixels rather than run markers.
 
-	// We process the PCX a whole frame at a time because the lines are reversed
-	// in CEL.
-	auto frameBuffer = std::unique_ptr<uint8_t[]>(
-	    new uint8_t[static_cast<size_t>(frameHeight) * width]);
+constexpr uint8_t PcxRunMarkerBits = 0xC0;
 
+DVL_GFX_TARGET_SSE42 inline unsigned CopyPcxSinglePixelsSse42(const uint8_t *src, uint8_t *dst)
+{
+	const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+	if (dst != nullptr)
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst), v);
+	const __m128i markerBits = _mm_set1_epi8(static_cast<char>(PcxRunMarkerBits));
+	const auto markers = static_cast<uint32_t>(_mm_movemask_epi8(
+	    _mm_cmpeq_epi8(_mm_and_si128(v, markerBits), markerBits)));
+	return std::countr_zero(markers | 0x10000U);
+}
+
+DVL_GFX_TARGET_AVX2 inline unsigned CopyPcxSinglePixelsAvx2(const uint8_t *src, uint8_t *dst)
+{
+	const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+	if (dst != nullptr)
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), v);
+	const __m256i markerBits = _mm256_set1_epi8(static_cast<char>(PcxRunMarkerBits));
+	const auto markers = static_cast<uint32_t>(_mm256_movemask_epi8(
+	    _mm256_cmpeq_epi8(_mm256_and_si256(v, markerBits), markerBits)));
+	return std::countr_zero(static_cast<uint64_t>(markers) | (uint64_t { 1 } << 32));
+}
+
+DVL_GFX_TARGET_AVX512 inline unsigned CopyPcxSinglePixelsAvx512(const uint8_t *src, uint8_t *dst)
+{
+	const __m512i v = _mm512_loadu_si512(src);
+	if (dst != nullptr)
+		_mm512_storeu_si512(dst, v);
+	const uint64_t markers = _mm512_cmpge_epu8_mask(v, _mm512_set1_epi8(static_cast<char>(PcxRunMarkerBits)));
+	return markers == 0 ? 64 : std::countr_zero(markers);
+}
+#endif
+
+template <CpuIsa Isa>
+DVL_GFX_ALWAYS_INLINE const uint8_t *DecodePcxLinesImpl(const uint8_t *dataPtr, const uint8_t *dataEnd,
+    int width, unsigned numLines, uint8_t *buffer)
+{
 	const unsigned srcSkip = width % 2;
-	const uint8_t *dataPtr = pixelData;
-	for (unsigned frame = 1; frame <= numFrames; ++frame) {
-		WriteLE32(&clxData[4 * static_cast<size_t>(frame)],
-		    static_cast<uint32_t>(clxData.size()));
-
-		// Frame header: 5 16-bit values:
-		// 1. Offset to start of the pixel data.
-		// 2. Width
-		// 3. Height
-		// 4..5. Unused (0)
-		const size_t frameHeaderPos = clxData.size();
-		clxData.resize(clxData.size() + ClxFrameHeaderSize);
-
-		// Frame header:
-		const uint16_t frameWidth = cropWidths.empty()
-		    ? static_cast<uint16_t>(width)
-		    : cropWidths[std::min<size_t>(cropWidths.size(), frame) - 1];
-
-		WriteLE16(&clxData[frameHeaderPos], ClxFrameHeaderSize);
-		WriteLE16(&clxData[frameHeaderPos + 2], static_cast<uint16_t>(frameWidth));
-		WriteLE16(&clxData[frameHeaderPos + 4], static_cast<uint16_t>(frameHeight));
-
-		for (unsigned j = 0; j < frameHeight; ++j) {
-			uint8_t *buffer = &frameBuffer[static_cast<size_t>(j) * width];
-			for (unsigned x = 0; x < static_cast<unsigned>(width);) {
-				constexpr uint8_t PcxMaxSinglePixel = 0xBF;
-				const uint8_t byte = *dataPtr++;
-				if (byte <= PcxMaxSinglePixel) {
-					*buffer++ = byte;
-					++x;
-					continue;
+	for (unsigned j = 0; j < numLines; ++j) {
+		for (unsigned x = 0; x < static_cast<unsigned>(width);) {
+#ifdef DVL_GFX_X86_DISPATCH
+			if constexpr (Isa != CpuIsa::Scalar) {
+				// Copy a whole vector of single pixels at once, as long as
+				// both the vector load and store stay within their buffers.
+				constexpr unsigned VectorSize = Isa == CpuIsa::Avx512 ? 64 : (Isa == CpuIsa::Avx2 ? 32 : 16);
+				if (static_cast<unsigned>(width) - x >= VectorSize && dataEnd - dataPtr >= VectorSize) {
+					unsigned numPixels;
+					if constexpr (Isa == CpuIsa::Avx512) {
+						numPixels = CopyPcxSinglePixelsAvx512(dataPtr, buffer);
+					} else if constexpr (Isa == CpuIsa::Avx2) {
+						numPixels = CopyPcxSinglePixelsAvx2(dataPtr, buffer);
+					} else {
+						numPixels = CopyPcxSinglePixelsSse42(dataPtr, buffer);
+					}
+					dataPtr += numPixels;
+					if (buffer != nullptr)
+						buffer += numPixels;
+					x += numPixels;
+					if (numPixels == VectorSize)
+						continue;
 				}
-				constexpr uint8_t PcxRunLengthMask = 0x3F;
-				const uint8_t runLength = (byte & PcxRunLengthMask);
-				std::memset(buffer, *dataPtr++, runLength);
+			}
+#endif
+			constexpr uint8_t PcxMaxSinglePixel = 0xBF;
+			const uint8_t byte = *dataPtr++;
+			if (byte <= PcxMaxSinglePixel) {
+				if (buffer != nullptr)
+					*buffer++ = byte;
+				++x;
+				continue;
+			}
+			constexpr uint8_t PcxRunLengthMask = 0x3F;
+			const uint8_t runLength = (byte & PcxRunLengthMask);
+			if (buffer != nullptr) {
+				std::memset(buffer, *dataPtr, runLength);
 				buffer += runLength;
-				x += runLength;
 			}
-			dataPtr += srcSkip;
+			++dataPtr;
+			x += runLength;
 		}
+		dataPtr += srcSkip;
+	}
+	return dataPtr;
+}
 
-		unsigned transparentRunWidth = 0;
-		size_t line = 0;
-		while (line != frameHeight) {
-			// Process line:
-			const uint8_t *src = &frameBuffer[(frameHeight - (line + 1)) * width];
-			if (transparentColor) {
-				unsigned solidRunWidth = 0;
-				for (const uint8_t *srcEnd = src + frameWidth; src != srcEnd; ++src) {
-					if (*src == *transparentColor) {
-						if (solidRunWidth != 0) {
-							AppendClxPixelsOrFillRun(
-							    src - transparentRunWidth - solidRunWidth, solidRunWidth,
-							    clxData);
-							solidRunWidth = 0;
-						}
-						++transparentRunWidth;
-					} else {
-						AppendClxTransparentRun(transparentRunWidth, clxData);
-						transparentRunWidth = 0;
-						++solidRunWidth;
-					}
-				}
-				if (solidRunWidth != 0) {
-					AppendClxPixelsOrFillRun(src - solidRunWidth, solidRunWidth, clxData);
-				}
-			} else {
-				AppendClxPixelsOrFillRun(src, width, clxData);
-			}
-			++line;
+#ifdef DVL_GFX_X86_DISPATCH
+DVL_GFX_TARGET_SSE42 const uint8_t *DecodePcxLinesSse42(const uint8_t *dataPtr, const uint8_t *dataEnd,
+    int width, unsigned numLines, uint8_t *buffer)
+{
+	return DecodePcxLinesImpl<CpuIsa::Sse42>(dataPtr, dataEnd, width, numLines, buffer);
+}
+
+DVL_GFX_TARGET_AVX2 const uint8_t *DecodePcxLinesAvx2(const uint8_t *dataPtr, const uint8_t *dataEnd,
+    int width, unsigned numLines, uint8_t *buffer)
+{
+	return DecodePcxLinesImpl<CpuIsa::Avx2>(dataPtr, dataEnd, width, numLines, buffer);
+}
+
+DVL_GFX_TARGET_AVX512 const uint8_t *DecodePcxLinesAvx512(const uint8_t *dataPtr, const uint8_t *dataEnd,
+    int width, unsigned numLines, uint8_t *buffer)
+{
+	return DecodePcxLinesImpl<CpuIsa::Avx512>(dataPtr, dataEnd, width, numLines, buffer);
+}
+#endif
+
+/**
+ * @brief Decodes `numLines` lines of RLE-compressed PCX pixel data.
+ *
+ * @param dataEnd End of the PCX data. Only used to keep vector loads within bounds.
+ * @param buffer Output buffer of `numLines * width` bytes, or `nullptr` to only skip the lines.
+ * @return Pointer past the end of the decoded lines.
+ */
+const uint8_t *DecodePcxLines(const uint8_t *dataPtr, const uint8_t *dataEnd,
+    int width, unsigned numLines, uint8_t *buffer)
+{
+	switch (GetCpuIsa()) {
+#ifdef DVL_GFX_X86_DISPATCH
+	case CpuIsa::Avx512:
+		return DecodePcxLinesAvx512(dataPtr, dataEnd, width, numLines, buffer);
+	case CpuIsa::Avx2:
+		return DecodePcxLinesAvx2(dataPtr, dataEnd, width, numLines, buffer);
+	case CpuIsa::Sse42:
+		return DecodePcxLinesSse42(dataPtr, dataEnd, width, numLines, buffer);
+#endif
+	default:
+		return DecodePcxLinesImpl<CpuIsa::Scalar>(dataPtr, dataEnd, width, numLines, buffer);
+	}
+}
+
+/**
+ * @return Pointer past the end of the PCX pixel data.
+ */
+template <typename Out>
+const uint8_t *EncodePcxFrames(const PcxFrames &frames,
+    std::optional<uint8_t> transparentColor,
+    const std::vector<uint16_t> &cropWidths,
+    const ClxEncodeOptions &options, Out &out)
+{
+	const int width = frames.width;
+	const unsigned frameHeight = frames.frameHeight;
+	const unsigned numFrames = frames.numFrames;
+
+	// CLX header: frame count, frame offset for each frame, file size
+	out.appendZeros(4 * (2 + static_cast<size_t>(numFrames)));
+	out.writeLE32At(0, numFrames);
+
+	// The frames are RLE-compressed back to back, so when encoding them
+	// concurrently we first find where each one begins.
+	// Otherwise, each frame begins where the previous one ended.
+	std::vector<const uint8_t *> frameData;
+	const uint8_t *dataPtr = frames.pixelData;
+	if (std::is_same_v<Out, ClxWriter> && numFrames > 1 && ResolveNumThreads(options.numThreads) > 1) {
+		frameData.resize(numFrames);
+		for (unsigned frame = 0; frame < numFrames; ++frame) {
+			frameData[frame] = dataPtr;
+			dataPtr = DecodePcxLines(dataPtr, frames.dataEnd, width, frameHeight, nullptr);
 		}
-		AppendClxTransparentRun(transparentRunWidth, clxData);
 	}
-	WriteLE32(&clxData[4 * (1 + static_cast<size_t>(numFrames))],
-	    static_cast<uint32_t>(clxData.size()));
+
+	// We process the PCX a whole frame at a time because the lines are reversed
+	// in CEL.
+	EncodeClxFrames(
+	    numFrames, options.numThreads, out,
+	    [&](size_t frame, auto &frameOut) {
+		    thread_local std::vector<uint8_t> frameBufferStorage;
+		    frameBufferStorage.resize(static_cast<size_t>(frameHeight) * width);
+		    uint8_t *frameBuffer = frameBufferStorage.data();
+		    if (frameData.empty()) {
+			    dataPtr = DecodePcxLines(dataPtr, frames.dataEnd, width, frameHeight, frameBuffer);
+		    } else {
+			    DecodePcxLines(frameData[frame], frames.dataEnd, width, frameHeight, frameBuffer);
+		    }
+
+		    const uint16_t frameWidth = cropWidths.empty()
+		        ? static_cast<uint16_t>(width)
+		        : cropWidths[std::min<size_t>(cropWidths.size(), frame + 1) - 1];
+
+		    // A single frame is split into bands of lines instead.
+		    const unsigned numLineThreads = numFrames == 1 ? options.numThreads : 1;
+		    EncodeClxFrameFromPixels(frameBuffer, width, frameWidth, frameHeight,
+		        transparentColor, options, numLineThreads, frameOut);
+	    },
+	    [&](size_t frame, size_t pos) {
+		    out.writeLE32At(4 * (1 + frame), static_cast<uint32_t>(pos));
+	    });
+	return dataPtr;
+}
+
+} // namespace
+
+std::optional<IoError> MeasurePcxToClxSize(const uint8_t *data, size_t size,
+    int numFramesOrFrameHeight,
+    std::optional<uint8_t> transparentColor,
+    const std::vector<uint16_t> &cropWidths,
+    size_t &clxSize,
+    const ClxEncodeOptions &options)
+{
+	PcxFrames frames;
+	if (std::optional<IoError> error = LoadPcxFrames(data, size, numFramesOrFrameHeight, frames);
+	    error.has_value()) {
+		return error;
+	}
+	ClxSizeCounter counter;
+	EncodePcxFrames(frames, transparentColor, cropWidths, options, counter);
+	clxSize = counter.size();
+	return std::nullopt;
+}
+
+std::optional<IoError> PcxToClx(const uint8_t *data, size_t size,
+    int numFramesOrFrameHeight,
+    std::optional<uint8_t> transparentColor,
+    const std::vector<uint16_t> &cropWidths,
+    std::vector<uint8_t> &clxData,
+    uint8_t *paletteData,
+    const ClxEncodeOptions &options)
+{
+	PcxFrames frames;
+	if (std::optional<IoError> error = LoadPcxFrames(data, size, numFramesOrFrameHeight, frames);
+	    error.has_value()) {
+		return error;
+	}
+
+	clxData.clear();
+	clxData.reserve(size - PcxHeaderSize);
+	ClxWriter out { clxData };
+	const uint8_t *dataPtr = EncodePcxFrames(frames, transparentColor, cropWidths, options, out);
 
 	if (paletteData != nullptr) {
 		constexpr unsigned PcxPaletteSeparator = 0x0C;
 		if (*dataPtr++ != PcxPaletteSeparator)
 			return IoError { std::string("PCX has no palette") };
 
-		uint8_t *out = paletteData;
+		uint8_t *paletteOut = paletteData;
 		for (unsigned i = 0; i < 256; ++i) {
-			*out++ = *dataPtr++;
-			*out++ = *dataPtr++;
-			*out++ = *dataPtr++;
+			*paletteOut++ = *dataPtr++;
+			*paletteOut++ = *dataPtr++;
+			*paletteOut++ = *dataPtr++;
 		}
 	}
 	return std::nullopt;
@@ -152,7 +312,8 @@ std::optional<IoError> PcxToClx(const char *inputPath, const char *outputPath,
     const std::vector<uint16_t> &cropWidths,
     bool exportPalette,
     uintmax_t *inputFileSize,
-    uintmax_t *outputFileSize)
+    uintmax_t *outputFileSize,
+    const ClxEncodeOptions &options)
 {
 	std::ifstream input;
 	input.open(inputPath, std::ios::in | std::ios::binary);
@@ -180,7 +341,7 @@ std::optional<IoError> PcxToClx(const char *inputPath, const char *outputPath,
 	std::array<uint8_t, 256 * 3> paletteData;
 	if (const std::optional<IoError> error = PcxToClx(
 	        fileBuffer.get(), pixelDataSize, numFramesOrFrameHeight, transparentColor,
-	        cropWidths, clxData, exportPalette ? paletteData.data() : nullptr);
+	        cropWidths, clxData, exportPalette ? paletteData.data() : nullptr, options);
 	    error.has_value()) {
 		return error;
 	}
@@ -25,6 +25,10 @@ Options:
   --num-sprites <arg>             The number of vertically-stacked sprites. Default: 1.
   --crop-widths <arg>[,<arg>...]  Crop sprites to the given width(s) by removing the right side of the sprite. Default: none.
   --export-palette                Export the palette as a .pal file.
+  --optimize                      Find the smallest possible encoding. Slower.
+  -j, --jobs <arg>                Number of threads to encode on, 0 for one per CPU core. Default: 1.
+  --row-skip-interval <arg>       Write a row-skip table with every <arg>-th line, so that
+                                  decoders can start at any line quickly. Default: none.
   --remove                        Remove the input files.
   -q, --quiet                     Do not log anything.
 )";
@@ -36,6 +40,7 @@ struct Options {
 	std::optional<uint8_t> transparentColor;
 	std::vector<uint16_t> cropWidths;
 	bool exportPalette = false;
+	ClxEncodeOptions encodeOptions;
 	bool remove = false;
 	bool quiet = false;
 };
@@ -81,6 +86,18 @@ tl::expected<Options, ArgumentError> ParseArguments(int argc, char *argv[])
 			options.cropWidths = *std::move(value);
 		} else if (arg == "--export-palette") {
 			options.exportPalette = true;
+		} else if (arg == "--optimize") {
+			options.encodeOptions.optimize = true;
+		} else if (arg == "-j" || arg == "--jobs") {
+			tl::expected<unsigned, ArgumentError> value = ParseIntArgument<unsigned>(state);
+			if (!value.has_value())
+				return tl::unexpected { std::move(value).error() };
+			options.encodeOptions.numThreads = *value;
+		} else if (arg == "--row-skip-interval") {
+			tl::expected<unsigned, ArgumentError> value = ParseIntArgument<unsigned>(state);
+			if (!value.has_value())
+				return tl::unexpected { std::move(value).error() };
+			options.encodeOptions.rowSkipInterval = *value;
 		} else if (arg == "--remove") {
 			options.remove = true;
 		} else if (arg == "-q" || arg == "--quiet") {
@@ -118,7 +135,8 @@ std::optional<IoError> Run(const Options &options)
 		uintmax_t inputFileSize;
 		uintmax_t outputFileSize;
 		if (std::optional<dvl_gfx::IoError> error = PcxToClx(inputPath, outputPath.string().c_str(), options.numSprites,
-		        options.transparentColor, options.cropWidths, options.exportPalette, &inputFileSize, &outputFileSize);
+		        options.transparentColor, options.cropWidths, options.exportPalette, &inputFileSize, &outputFileSize,
+		        options.encodeOptions);
 		    error.has_value()) {
 			error->message.append(": ").append(inputPath);
 			return error;
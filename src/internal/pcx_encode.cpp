@@ -1,5 +1,6 @@
 #include <pcx_encode.hpp>
 
+#include <bit>
 #include <cerrno>
 #include <cstdint>
 #include <cstdio>
@@ -9,11 +10,18 @@
 #include <memory>
 #include <optional>
 #include <span>
+#include <string>
 
 #include <dvl_gfx_common.hpp>
 #include <dvl_gfx_endian.hpp>
 #include <pcx.hpp>
 
+#include "cpu_dispatch.hpp"
+
+#ifdef DVL_GFX_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
 namespace dvl_gfx {
 namespace {
 
@@ -57,30 +65,81 @@ bool CapturePal(std::span<const uint8_t> palette, std::ostream *out)
 	return !out->fail();
 }
 
-/**
- * @brief RLE compress the pixel data
- * @param src Raw pixel buffer
- * @param dst Output buffer
- * @param width Width of pixel buffer
+#ifdef DVL_GFX_X86_DISPATCH
+// Each of these copies a vector of pixels to `dst` and returns the number of
+// leading pixels that are encoded as themselves, i.e. that differ from the next
+// pixel and cannot be mistaken for a run marker.
 
- * @return Output buffer
- */
-uint8_t *CaptureEnc(const uint8_t *src, uint8_t *dst, int width)
+constexpr uint8_t PcxRunMarkerBits = 0xC0;
+
+DVL_GFX_TARGET_SSE42 inline unsigned CopySinglePixelsSse42(const uint8_t *src, uint8_t *dst)
+{
+	const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+	const __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 1));
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(dst), v);
+	const __m128i markerBits = _mm_set1_epi8(static_cast<char>(PcxRunMarkerBits));
+	const auto stops = static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(
+	    _mm_cmpeq_epi8(v, next), _mm_cmpeq_epi8(_mm_and_si128(v, markerBits), markerBits))));
+	return std::countr_zero(stops | 0x10000U);
+}
+
+DVL_GFX_TARGET_AVX2 inline unsigned CopySinglePixelsAvx2(const uint8_t *src, uint8_t *dst)
+{
+	const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+	const __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 1));
+	_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), v);
+	const __m256i markerBits = _mm256_set1_epi8(static_cast<char>(PcxRunMarkerBits));
+	const auto stops = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(
+	    _mm256_cmpeq_epi8(v, next), _mm256_cmpeq_epi8(_mm256_and_si256(v, markerBits), markerBits))));
+	return std::countr_zero(static_cast<uint64_t>(stops) | (uint64_t { 1 } << 32));
+}
+
+DVL_GFX_TARGET_AVX512 inline unsigned CopySinglePixelsAvx512(const uint8_t *src, uint8_t *dst)
+{
+	const __m512i v = _mm512_loadu_si512(src);
+	_mm512_storeu_si512(dst, v);
+	const uint64_t stops = _mm512_cmpeq_epi8_mask(v, _mm512_loadu_si512(src + 1))
+	    | _mm512_cmpge_epu8_mask(v, _mm512_set1_epi8(static_cast<char>(PcxRunMarkerBits)));
+	return stops == 0 ? 64 : std::countr_zero(stops);
+}
+#endif
+
+template <CpuIsa Isa>
+DVL_GFX_ALWAYS_INLINE uint8_t *CaptureEncImpl(const uint8_t *src, uint8_t *dst, int width)
 {
 	int rleLength;
 
 	do {
+#ifdef DVL_GFX_X86_DISPATCH
+		if constexpr (Isa != CpuIsa::Scalar) {
+			// Copy a whole vector of single pixels at once. Each pixel is compared
+			// with the next one, so one more pixel than the vector size must remain.
+			// `dst` has room for 2 bytes per remaining pixel, so the store is in bounds.
+			constexpr int VectorSize = Isa == CpuIsa::Avx512 ? 64 : (Isa == CpuIsa::Avx2 ? 32 : 16);
+			if (width > VectorSize) {
+				unsigned numPixels;
+				if constexpr (Isa == CpuIsa::Avx512) {
+					numPixels = CopySinglePixelsAvx512(src, dst);
+				} else if constexpr (Isa == CpuIsa::Avx2) {
+					numPixels = CopySinglePixelsAvx2(src, dst);
+				} else {
+					numPixels = CopySinglePixelsSse42(src, dst);
+				}
+				src += numPixels;
+				dst += numPixels;
+				width -= static_cast<int>(numPixels);
+				if (numPixels == VectorSize)
+					continue;
+			}
+		}
+#endif
 		uint8_t rlePixel = *src;
 		src++;
 		rleLength = 1;
 
 		width--;
 
-		while (rlePixel == *src) {
-			if (rleLength >= 63)
-				break;
-			if (width == 0)
-				break;
+		while (width != 0 && rleLength < 63 && *src == rlePixel) {
 			rleLength++;
 
 			width--;
@@ -99,6 +158,47 @@ uint8_t *CaptureEnc(const uint8_t *src, uint8_t *dst, int width)
 	return dst;
 }
 
+#ifdef DVL_GFX_X86_DISPATCH
+DVL_GFX_TARGET_SSE42 uint8_t *CaptureEncSse42(const uint8_t *src, uint8_t *dst, int width)
+{
+	return CaptureEncImpl<CpuIsa::Sse42>(src, dst, width);
+}
+
+DVL_GFX_TARGET_AVX2 uint8_t *CaptureEncAvx2(const uint8_t *src, uint8_t *dst, int width)
+{
+	return CaptureEncImpl<CpuIsa::Avx2>(src, dst, width);
+}
+
+DVL_GFX_TARGET_AVX512 uint8_t *CaptureEncAvx512(const uint8_t *src, uint8_t *dst, int width)
+{
+	return CaptureEncImpl<CpuIsa::Avx512>(src, dst, width);
+}
+#endif
+
+/**
+ * @brief RLE compress the pixel data
+ * @param src Raw pixel buffer
+ * @param dst Output buffer, at least `2 * width` bytes
+ * @param width Width of pixel buffer
+
+ * @return Output buffer
+ */
+uint8_t *CaptureEnc(const uint8_t *src, uint8_t *dst, int width)
+{
+	switch (GetCpuIsa()) {
+#ifdef DVL_GFX_X86_DISPATCH
+	case CpuIsa::Avx512:
+		return CaptureEncAvx512(src, dst, width);
+	case CpuIsa::Avx2:
+		return CaptureEncAvx2(src, dst, width);
+	case CpuIsa::Sse42:
+		return CaptureEncSse42(src, dst, width);
+#endif
+	default:
+		return CaptureEncImpl<CpuIsa::Scalar>(src, dst, width);
+	}
+}
+
 /**
  * @brief Write the pixel data to the PCX file
  *
@@ -121,6 +221,11 @@ bool CapturePix(std::span<const uint8_t> pixels, Size size, uint32_t pitch, std:
 	return true;
 }
 
+IoError PcxWriteError()
+{
+	return IoError { std::string("Failed when writing PCX file: ").append(std::strerror(errno)) };
+}
+
 } // namespace
 
 std::optional<IoError> PcxEncode(
@@ -135,9 +240,31 @@ std::optional<IoError> PcxEncode(
 		success = CapturePal(palette, out);
 	}
 	if (!success) {
-		return IoError { std::string("Failed when writing PCX file: ").append(std::strerror(errno)) };
+		return PcxWriteError();
 	}
 	return std::nullopt;
 }
 
+std::optional<IoError> PcxEncodeHeader(Size size, std::ostream *out)
+{
+	if (!CaptureHdr(size.width, size.height, out))
+		return PcxWriteError();
+	return std::nullopt;
+}
+
+std::optional<IoError> PcxEncodeLines(
+    std::span<const uint8_t> pixels, Size size, uint32_t pitch, std::ostream *out)
+{
+	if (!CapturePix(pixels, size, pitch, out))
+		return PcxWriteError();
+	return std::nullopt;
+}
+
+std::optional<IoError> PcxEncodePalette(std::span<const uint8_t> palette, std::ostream *out)
+{
+	if (!CapturePal(palette, out))
+		return PcxWriteError();
+	return std::nullopt;
+}
+
 } // namespace dvl_gfx
@@ -6,6 +6,7 @@
 #include <ostream>
 #include <span>
 
+#include <clx2pixels.hpp>
 #include <dvl_gfx_common.hpp>
 
 namespace dvl_gfx {
@@ -14,4 +15,48 @@ std::optional<IoError> PcxEncode(
     std::span<const uint8_t> pixels, Size size, uint32_t pitch,
     std::span<const uint8_t> palette, std::ostream *out);
 
+// `PcxEncode` in parts, for images that are encoded a few lines at a time:
+//
+//     PcxEncodeHeader(size); PcxEncodeLines(...) for every group of lines, top to bottom; PcxEncodePalette(...);
+
+/**
+ * @brief Writes the header of a PCX image of the given size.
+ */
+std::optional<IoError> PcxEncodeHeader(Size size, std::ostream *out);
+
+/**
+ * @brief Writes the next `size.height` lines of the image, each `size.width` pixels wide.
+ */
+std::optional<IoError> PcxEncodeLines(
+    std::span<const uint8_t> pixels, Size size, uint32_t pitch, std::ostream *out);
+
+/**
+ * @brief Writes the palette that ends the PCX file.
+ */
+std::optional<IoError> PcxEncodePalette(std::span<const uint8_t> palette, std::ostream *out);
+
+/**
+ * @brief Writes a CLX as a PCX with the frames stacked like `Clx2Pixels`, a band of lines as tall as
+ * the tallest frame at a time, so that the whole image is never held in memory.
+ */
+inline std::optional<IoError> PcxEncodeStackedClx(
+    std::span<const uint8_t> clxData, uint8_t transparentColor,
+    std::span<const uint8_t> palette, std::ostream *out, const ClxDecodeOptions &options = {})
+{
+	if (std::optional<IoError> error = Clx2PixelBands(
+	        clxData, transparentColor, /*bandHeight=*/0,
+	        [&](const ClxPixelBand &band) -> std::optional<IoError> {
+		        if (band.firstLine == 0) {
+			        if (std::optional<IoError> error = PcxEncodeHeader(band.imageSize, out); error.has_value())
+				        return error;
+		        }
+		        return PcxEncodeLines(band.pixels, Size { band.imageSize.width, band.numLines }, band.imageSize.width, out);
+	        },
+	        options);
+	    error.has_value()) {
+		return error;
+	}
+	return PcxEncodePalette(palette, out);
+}
+
 } // namespace dvl_gfx
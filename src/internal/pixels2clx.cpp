@@ -1,82 +1,200 @@
 #include <pixels2clx.hpp>
 
+#include <cerrno>
 #include <cstdint>
+#include <cstring>
 #include <memory>
+#include <ostream>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <dvl_gfx_common.hpp>
 #include <dvl_gfx_endian.hpp>
 
 #include "clx_encode.hpp"
+#include "clx_encode_frames.hpp"
+#include "clx_encode_pixels.hpp"
 
 namespace dvl_gfx {
 
-void Pixels2Clx(
+namespace {
+
+template <typename Out>
+void EncodePixels(
     const uint8_t *pixels,
     unsigned pitch, unsigned width, unsigned frameHeight, unsigned numFrames,
-    std::optional<uint8_t> transparentColor, std::vector<uint8_t> &clxData)
+    std::optional<uint8_t> transparentColor, const ClxEncodeOptions &options, Out &out)
 {
 	// CL2 header: frame count, frame offset for each frame, file size
-	clxData.resize(4 * (2 + static_cast<size_t>(numFrames)));
-	WriteLE32(clxData.data(), numFrames);
-
-	const unsigned height = frameHeight * numFrames;
+	out.appendZeros(4 * (2 + static_cast<size_t>(numFrames)));
+	out.writeLE32At(0, numFrames);
 
 	// We process the surface a whole frame at a time because the lines are reversed in CEL.
-	for (unsigned frame = 1; frame <= numFrames; ++frame) {
-		WriteLE32(&clxData[4 * static_cast<size_t>(frame)],
-		    static_cast<uint32_t>(clxData.size()));
-
-		// Frame header: 5 16-bit values:
-		// 1. Offset to start of the pixel data.
-		// 2. Width
-		// 3. Height
-		// 4..5. Unused (0)
-		const size_t frameHeaderPos = clxData.size();
-		clxData.resize(clxData.size() + ClxFrameHeaderSize);
-
-		// Frame header:
-		WriteLE16(&clxData[frameHeaderPos], ClxFrameHeaderSize);
-		WriteLE16(&clxData[frameHeaderPos + 2], static_cast<uint16_t>(width));
-		WriteLE16(&clxData[frameHeaderPos + 4], static_cast<uint16_t>(frameHeight));
-
-		const uint8_t *frameBuffer = &pixels[static_cast<size_t>((frame - 1) * pitch * frameHeight)];
-		unsigned transparentRunWidth = 0;
-		size_t line = 0;
-		while (line != frameHeight) {
-			// Process line:
-			const uint8_t *src = &frameBuffer[(frameHeight - (line + 1)) * pitch];
-			if (transparentColor) {
-				unsigned solidRunWidth = 0;
-				for (const uint8_t *srcEnd = src + width; src != srcEnd; ++src) {
-					if (*src == *transparentColor) {
-						if (solidRunWidth != 0) {
-							AppendClxPixelsOrFillRun(
-							    src - transparentRunWidth - solidRunWidth, solidRunWidth,
-							    clxData);
-							solidRunWidth = 0;
-						}
-						++transparentRunWidth;
-					} else {
-						AppendClxTransparentRun(transparentRunWidth, clxData);
-						transparentRunWidth = 0;
-						++solidRunWidth;
-					}
-				}
-				if (solidRunWidth != 0) {
-					AppendClxPixelsOrFillRun(src - solidRunWidth, solidRunWidth, clxData);
-				}
-			} else {
-				AppendClxPixelsOrFillRun(src, width, clxData);
-			}
-			++line;
-		}
-		AppendClxTransparentRun(transparentRunWidth, clxData);
+	EncodeClxFrames(
+	    numFrames, options.numThreads, out,
+	    [&](size_t frame, auto &frameOut) {
+		    const uint8_t *frameBuffer = &pixels[frame * pitch * frameHeight];
+		    // A single frame is split into bands of lines instead.
+		    const unsigned numLineThreads = numFrames == 1 ? options.numThreads : 1;
+		    EncodeClxFrameFromPixels(frameBuffer, pitch, width, frameHeight, transparentColor, options, numLineThreads, frameOut);
+	    },
+	    [&](size_t frame, size_t pos) {
+		    out.writeLE32At(4 * (1 + frame), static_cast<uint32_t>(pos));
+	    });
+}
+
+} // namespace
+
+size_t MeasurePixels2ClxSize(
+    const uint8_t *pixels,
+    unsigned pitch, unsigned width, unsigned frameHeight, unsigned numFrames,
+    std::optional<uint8_t> transparentColor, const ClxEncodeOptions &options)
+{
+	ClxSizeCounter counter;
+	EncodePixels(pixels, pitch, width, frameHeight, numFrames, transparentColor, options, counter);
+	return counter.size();
+}
+
+void Pixels2Clx(
+    const uint8_t *pixels,
+    unsigned pitch, unsigned width, unsigned frameHeight, unsigned numFrames,
+    std::optional<uint8_t> transparentColor, std::vector<uint8_t> &clxData,
+    const ClxEncodeOptions &options)
+{
+	clxData.clear();
+	ClxWriter out { clxData };
+	EncodePixels(pixels, pitch, width, frameHeight, numFrames, transparentColor, options, out);
+}
+
+ClxEncoder::ClxEncoder(ClxEncoderSink sink, const ClxEncodeOptions &options)
+    : sink_(std::move(sink))
+    , options_(options)
+{
+}
+
+std::optional<IoError> ClxEncoder::beginSheet(uint32_t numLists)
+{
+	if (inSheet_ || inList_)
+		return IoError { "ClxEncoder: beginSheet called inside a sheet or a list" };
+	inSheet_ = true;
+	sheetBegin_ = size_;
+	numLists_ = numLists;
+	listOffsets_.clear();
+	listOffsets_.reserve(numLists);
+	return write(std::vector<uint8_t>(ClxSheetHeaderSize(numLists)));
+}
+
+std::optional<IoError> ClxEncoder::beginList(uint32_t numFrames)
+{
+	if (inList_)
+		return IoError { "ClxEncoder: beginList called inside a list" };
+	if (inSheet_) {
+		if (listOffsets_.size() == numLists_)
+			return IoError { "ClxEncoder: more lists than declared in beginSheet" };
+		listOffsets_.push_back(static_cast<uint32_t>(size_ - sheetBegin_));
+	}
+	inList_ = true;
+	listBegin_ = size_;
+	numFrames_ = numFrames;
+	frameOffsets_.clear();
+	frameOffsets_.reserve(static_cast<size_t>(numFrames) + 1);
+
+	// CLX header: frame count, frame offset for each frame, file size.
+	// The offsets are filled in by `endList`.
+	std::vector<uint8_t> header(4 * (2 + static_cast<size_t>(numFrames)));
+	WriteLE32(header.data(), numFrames);
+	return write(header);
+}
+
+std::optional<IoError> ClxEncoder::addFrame(
+    const uint8_t *pixels, unsigned pitch, unsigned width, unsigned height,
+    std::optional<uint8_t> transparentColor)
+{
+	if (!inList_)
+		return IoError { "ClxEncoder: addFrame called outside of a list" };
+	if (frameOffsets_.size() == numFrames_)
+		return IoError { "ClxEncoder: more frames than declared in beginList" };
+	frameOffsets_.push_back(static_cast<uint32_t>(size_ - listBegin_));
+
+	frameData_.clear();
+	{
+		ClxWriter out { frameData_ };
+		EncodeClxFrameFromPixels(pixels, pitch, width, height, transparentColor, options_, options_.numThreads, out);
 	}
+	return write(frameData_);
+}
+
+std::optional<IoError> ClxEncoder::endList()
+{
+	if (!inList_)
+		return IoError { "ClxEncoder: endList called outside of a list" };
+	if (frameOffsets_.size() != numFrames_)
+		return IoError { "ClxEncoder: fewer frames than declared in beginList" };
+	inList_ = false;
+	frameOffsets_.push_back(static_cast<uint32_t>(size_ - listBegin_));
+
+	std::vector<uint8_t> offsets(4 * frameOffsets_.size());
+	for (size_t i = 0; i < frameOffsets_.size(); ++i)
+		WriteLE32(&offsets[4 * i], frameOffsets_[i]);
+	return sink_.writeAt(listBegin_ + 4, offsets);
+}
 
-	WriteLE32(&clxData[4 * (1 + static_cast<size_t>(numFrames))],
-	    static_cast<uint32_t>(clxData.size()));
+std::optional<IoError> ClxEncoder::endSheet()
+{
+	if (!inSheet_ || inList_)
+		return IoError { "ClxEncoder: endSheet called outside of a sheet or inside a list" };
+	if (listOffsets_.size() != numLists_)
+		return IoError { "ClxEncoder: fewer lists than declared in beginSheet" };
+	inSheet_ = false;
+
+	std::vector<uint8_t> offsets(ClxSheetHeaderSize(numLists_));
+	for (size_t i = 0; i < listOffsets_.size(); ++i)
+		WriteLE32(&offsets[4 * i], listOffsets_[i]);
+	return sink_.writeAt(sheetBegin_, offsets);
+}
+
+std::optional<IoError> ClxEncoder::write(std::span<const uint8_t> data)
+{
+	size_ += data.size();
+	return sink_.write(data);
+}
+
+ClxEncoderSink MakeClxVectorSink(std::vector<uint8_t> &out)
+{
+	const size_t begin = out.size();
+	return ClxEncoderSink {
+		.write = [&out](std::span<const uint8_t> data) -> std::optional<IoError> {
+		    out.insert(out.end(), data.begin(), data.end());
+		    return std::nullopt;
+		},
+		.writeAt = [&out, begin](size_t offset, std::span<const uint8_t> data) -> std::optional<IoError> {
+		    std::memcpy(&out[begin + offset], data.data(), data.size());
+		    return std::nullopt;
+		},
+	};
+}
+
+ClxEncoderSink MakeClxStreamSink(std::ostream &out)
+{
+	const std::streamoff begin = out.tellp();
+	return ClxEncoderSink {
+		.write = [&out](std::span<const uint8_t> data) -> std::optional<IoError> {
+		    out.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
+		    if (out.fail())
+			    return IoError { std::string("Failed to write to output stream: ").append(std::strerror(errno)) };
+		    return std::nullopt;
+		},
+		.writeAt = [&out, begin](size_t offset, std::span<const uint8_t> data) -> std::optional<IoError> {
+		    const std::streampos end = out.tellp();
+		    out.seekp(begin + static_cast<std::streamoff>(offset));
+		    out.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
+		    out.seekp(end);
+		    if (out.fail())
+			    return IoError { std::string("Failed to write to output stream: ").append(std::strerror(errno)) };
+		    return std::nullopt;
+		},
+	};
 }
 
 } // namespace dvl_gfx
@@ -0,0 +1,143 @@
+#include "rect_packer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+namespace dvl_gfx {
+
+namespace {
+
+/**
+ * @brief A horizontal segment of the top edge of the packed rectangles.
+ * The segments are sorted by `x` and together span the whole width.
+ */
+struct SkylineSegment {
+	uint32_t x;
+	uint32_t y;
+	uint32_t width;
+};
+
+/**
+ * @return The lowest y at which a rectangle of `width` fits with its left edge at segment `i`,
+ *     or `std::nullopt` if it would stick out past `imageWidth`.
+ */
+std::optional<uint32_t> FitAtSegment(const std::vector<SkylineSegment> &skyline, size_t i, uint32_t width, uint32_t imageWidth)
+{
+	if (skyline[i].x + width > imageWidth)
+		return std::nullopt;
+	uint32_t y = 0;
+	for (uint32_t covered = 0; covered < width; ++i) {
+		y = std::max(y, skyline[i].y);
+		covered += skyline[i].width;
+	}
+	return y;
+}
+
+/**
+ * @brief Raises the skyline under a rectangle placed at segment `i`.
+ */
+void AddToSkyline(std::vector<SkylineSegment> &skyline, size_t i, uint32_t width, uint32_t top)
+{
+	const uint32_t x = skyline[i].x;
+	const uint32_t right = x + width;
+	// Remove the segments that the rectangle covers completely and shorten the last one it covers partially.
+	size_t end = i;
+	while (end < skyline.size() && skyline[end].x + skyline[end].width <= right)
+		++end;
+	if (end < skyline.size() && skyline[end].x < right) {
+		skyline[end].width -= right - skyline[end].x;
+		skyline[end].x = right;
+	}
+	skyline.erase(skyline.begin() + static_cast<std::ptrdiff_t>(i), skyline.begin() + static_cast<std::ptrdiff_t>(end));
+	skyline.insert(skyline.begin() + static_cast<std::ptrdiff_t>(i), SkylineSegment { x, top, width });
+
+	// Merge with neighbours of the same height, so that the skyline stays short.
+	if (i + 1 < skyline.size() && skyline[i + 1].y == top) {
+		skyline[i].width += skyline[i + 1].width;
+		skyline.erase(skyline.begin() + static_cast<std::ptrdiff_t>(i + 1));
+	}
+	if (i > 0 && skyline[i - 1].y == top) {
+		skyline[i - 1].width += skyline[i].width;
+		skyline.erase(skyline.begin() + static_cast<std::ptrdiff_t>(i));
+	}
+}
+
+} // namespace
+
+Size PackRectsSkyline(std::span<const Size> sizes, uint32_t width, std::vector<PackedPosition> &positions)
+{
+	positions.assign(sizes.size(), PackedPosition { 0, 0 });
+
+	// Tallest first, so that each row of the skyline is filled with rectangles of similar heights.
+	std::vector<uint32_t> order;
+	order.reserve(sizes.size());
+	for (size_t i = 0; i < sizes.size(); ++i) {
+		if (sizes[i].width != 0 && sizes[i].height != 0)
+			order.push_back(static_cast<uint32_t>(i));
+	}
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+		if (sizes[a].height != sizes[b].height)
+			return sizes[a].height > sizes[b].height;
+		return sizes[a].width > sizes[b].width;
+	});
+
+	std::vector<SkylineSegment> skyline { SkylineSegment { 0, 0, width } };
+	Size result { 0, 0 };
+	for (const uint32_t rect : order) {
+		const Size size = sizes[rect];
+		size_t bestSegment = 0;
+		uint32_t bestY = 0;
+		uint32_t bestTop = std::numeric_limits<uint32_t>::max();
+		for (size_t i = 0; i < skyline.size(); ++i) {
+			const std::optional<uint32_t> y = FitAtSegment(skyline, i, size.width, width);
+			if (!y.has_value())
+				break;
+			if (*y + size.height < bestTop) {
+				bestSegment = i;
+				bestY = *y;
+				bestTop = *y + size.height;
+			}
+		}
+		positions[rect] = PackedPosition { skyline[bestSegment].x, bestY };
+		result.width = std::max(result.width, skyline[bestSegment].x + size.width);
+		result.height = std::max(result.height, bestTop);
+		AddToSkyline(skyline, bestSegment, size.width, bestTop);
+	}
+	return result;
+}
+
+Size PackRects(std::span<const Size> sizes, std::optional<uint32_t> width, std::vector<PackedPosition> &positions)
+{
+	if (width.has_value())
+		return PackRectsSkyline(sizes, *width, positions);
+
+	uint64_t area = 0;
+	uint32_t maxWidth = 0;
+	for (const Size &size : sizes) {
+		area += static_cast<uint64_t>(size.width) * size.height;
+		maxWidth = std::max(maxWidth, size.width);
+	}
+	const double side = std::sqrt(static_cast<double>(area));
+
+	Size best {};
+	std::vector<PackedPosition> candidate;
+	bool first = true;
+	for (const double factor : { 1.0, 1.125, 1.25, 1.5, 2.0 }) {
+		const uint32_t candidateWidth = std::max(maxWidth, static_cast<uint32_t>(std::ceil(side * factor)));
+		const Size size = PackRectsSkyline(sizes, candidateWidth, candidate);
+		// Only go wider if it saves more than 1% of the area, to keep the atlas close to square.
+		if (first || static_cast<uint64_t>(size.width) * size.height * 100 < static_cast<uint64_t>(best.width) * best.height * 99) {
+			best = size;
+			positions.swap(candidate);
+			first = false;
+		}
+	}
+	return best;
+}
+
+} // namespace dvl_gfx
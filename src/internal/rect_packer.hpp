@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <dvl_gfx_common.hpp>
+
+namespace dvl_gfx {
+
+struct PackedPosition {
+	uint32_t x;
+	uint32_t y;
+};
+
+/**
+ * @brief Packs rectangles into an image of the given width with the skyline bottom-left
+ * heuristic, tallest rectangles first.
+ *
+ * Empty rectangles are placed at (0, 0).
+ *
+ * @param width Must be at least as large as the widest rectangle.
+ * @param positions Set to the position of each rectangle.
+ * @return The size of the bounding box of the packed rectangles.
+ */
+Size PackRectsSkyline(std::span<const Size> sizes, uint32_t width, std::vector<PackedPosition> &positions);
+
+/**
+ * @brief Packs rectangles into a compact image, like `PackRectsSkyline`.
+ *
+ * @param width The width of the image. If `std::nullopt`, tries a few widths around
+ *     the square root of the total area and keeps the narrowest one that is about as small as any.
+ */
+Size PackRects(std::span<const Size> sizes, std::optional<uint32_t> width, std::vector<PackedPosition> &positions);
+
+} // namespace dvl_gfx
@@ -11,6 +11,18 @@
 
 namespace dvl_gfx {
 
+/**
+ * @brief Measures the exact size of the CLX data that `CelToClx` would produce for the same arguments.
+ *
+ * Runs the encoder without writing anything, e.g. to pre-size an output file.
+ *
+ * @param clxSize Output CLX size.
+ * @return std::optional<IoError>
+ */
+std::optional<IoError> MeasureCelToClxSize(const uint8_t *data, size_t size,
+    const uint16_t *widths, size_t numWidths, size_t &clxSize,
+    const ClxEncodeOptions &options = {});
+
 /**
  * @brief Converts a CEL image to CLX.
  *
@@ -19,22 +31,46 @@ namespace dvl_gfx {
  * @param widths Widths of each frame. If all the frame are the same width, this can be a single number.
  * @param numWidths The number of widths.
  * @param clxData Output CLX buffer.
+ * @param options Encoder options.
  * @return std::optional<IoError>
  */
 std::optional<IoError> CelToClx(const uint8_t *data, size_t size,
-    const uint16_t *widths, size_t numWidths, std::vector<uint8_t> &clxData);
+    const uint16_t *widths, size_t numWidths, std::vector<uint8_t> &clxData,
+    const ClxEncodeOptions &options = {});
+
+/**
+ * @brief Converts a CEL image to an 8-bit color-indexed pixel buffer without encoding it as CLX.
+ *
+ * The output is the same image that `Clx2Pixels` draws for the output of `CelToClx`:
+ * the frames of each group are stacked vertically and the groups horizontally.
+ * Unlike `CelToClx`, checks that the offset tables and commands lie within the data.
+ *
+ * @param data The CEL buffer.
+ * @param size CEL buffer size.
+ * @param widths Widths of each frame. If all the frame are the same width, this can be a single number.
+ * @param numWidths The number of widths.
+ * @param transparentColor Palette index of the transparent color.
+ * @param pixels Output pixel buffer, without padding.
+ * @param outDimensions If non-null, set to the dimensions of the resulting image.
+ * @return std::optional<IoError>
+ */
+std::optional<IoError> CelToPixels(const uint8_t *data, size_t size,
+    const uint16_t *widths, size_t numWidths, uint8_t transparentColor,
+    std::vector<uint8_t> &pixels, Size *outDimensions = nullptr);
 
 std::optional<IoError> CelToClx(const char *inputPath, const char *outputPath,
     const uint16_t *widths, size_t numWidths,
     uintmax_t *inputFileSize = nullptr,
-    uintmax_t *outputFileSize = nullptr);
+    uintmax_t *outputFileSize = nullptr,
+    const ClxEncodeOptions &options = {});
 
 inline std::optional<IoError> CelToClx(const char *inputPath, const char *outputPath,
     const std::vector<uint16_t> &widths,
     uintmax_t *inputFileSize = nullptr,
-    uintmax_t *outputFileSize = nullptr)
+    uintmax_t *outputFileSize = nullptr,
+    const ClxEncodeOptions &options = {})
 {
-	return CelToClx(inputPath, outputPath, widths.data(), widths.size(), inputFileSize, outputFileSize);
+	return CelToClx(inputPath, outputPath, widths.data(), widths.size(), inputFileSize, outputFileSize, options);
 }
 
 } // namespace dvl_gfx
@@ -11,6 +11,18 @@
 
 namespace dvl_gfx {
 
+/**
+ * @brief Measures the exact size of the CLX data that `Cl2ToClx` would produce for the same arguments.
+ *
+ * Runs the encoder without writing anything, e.g. to pre-size an output file.
+ *
+ * @param clxSize Output CLX size.
+ * @return std::optional<IoError>
+ */
+std::optional<IoError> MeasureCl2ToClxSize(const uint8_t *data, size_t size,
+    const uint16_t *widths, size_t numWidths, size_t &clxSize,
+    const ClxEncodeOptions &options = {});
+
 /**
  * @brief Converts a CL2 image to CLX.
  *
@@ -21,10 +33,12 @@ namespace dvl_gfx {
  * @param size CL2 buffer size.
  * @param widths Widths of each frame. If all the frame are the same width, this can be a single number.
  * @param numWidths The number of widths.
+ * @param options Encoder options.
  * @return std::optional<IoError>
  */
 std::optional<IoError> Cl2ToClx(const uint8_t *data, size_t size,
-    const uint16_t *widths, size_t numWidths, std::vector<uint8_t> &out);
+    const uint16_t *widths, size_t numWidths, std::vector<uint8_t> &out,
+    const ClxEncodeOptions &options = {});
 
 /**
  * @brief Converts a CL2 image to CLX in-place without re-encoding.
@@ -41,12 +55,14 @@ std::optional<IoError> Cl2ToClxNoReencode(uint8_t *data, size_t size,
     const uint16_t *widths, size_t numWidths);
 
 std::optional<IoError> Cl2ToClx(const char *inputPath, const char *outputPath,
-    const uint16_t *widths, size_t numWidths, bool reencode = true);
+    const uint16_t *widths, size_t numWidths, bool reencode = true,
+    const ClxEncodeOptions &options = {});
 
 inline std::optional<IoError> Cl2ToClx(const char *inputPath, const char *outputPath,
-    const std::vector<uint16_t> &widths, bool reencode = true)
+    const std::vector<uint16_t> &widths, bool reencode = true,
+    const ClxEncodeOptions &options = {})
 {
-	return Cl2ToClx(inputPath, outputPath, widths.data(), widths.size(), reencode);
+	return Cl2ToClx(inputPath, outputPath, widths.data(), widths.size(), reencode, options);
 }
 
 /**
@@ -56,11 +72,13 @@ inline std::optional<IoError> Cl2ToClx(const char *inputPath, const char *output
  * @param numFiles The number of `inputPaths`.
  * @param widths Widths of each frame. If all the frame are the same width, this can be a single number.
  * @param reencode If true, reencodes the CL2 graphics data (our encoder produces slightly smaller files).
+ * @param options Encoder options, used if `reencode` is true.
  * @return std::optional<IoError>
  */
 std::optional<IoError> CombineCl2AsClxSheet(
     const char *const *inputPaths, size_t numFiles, const char *outputPath,
-    const std::vector<uint16_t> &widths, bool reencode = true);
+    const std::vector<uint16_t> &widths, bool reencode = true,
+    const ClxEncodeOptions &options = {});
 
 } // namespace dvl_gfx
 #endif // DVL_GFX_CL22CLX_H_
@@ -1,7 +1,9 @@
 #ifndef DVL_GFX_CLX2PIXELS_H_
 #define DVL_GFX_CLX2PIXELS_H_
 
+#include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <optional>
 #include <span>
 #include <vector>
@@ -22,10 +24,74 @@ Size MeasureVerticallyStackedClxListSize(std::span<const uint8_t> clxList);
  */
 Size MeasureHorizontallyStackedClxListOrSheetSize(std::span<const uint8_t> clxData);
 
+/**
+ * @brief Draws the opaque pixels of a single CLX sprite, such as one returned by `GetSpriteDataFromClxList`.
+ *
+ * Reads only the bytes of the sprite and writes only within its `width x height` rectangle:
+ * the part of an opaque command that runs past the end of its line is not drawn.
+ *
+ * @param clxSprite The CLX sprite, including its frame header.
+ * @param pixels The top-left pixel of the output.
+ * @param pitch The width of the line in the pixel buffer including padding.
+ */
+void ClxSprite2Pixels(std::span<const uint8_t> clxSprite, uint8_t *pixels, unsigned pitch);
+
+/**
+ * @brief Draws the opaque pixels of some of the lines of a single CLX sprite, like `ClxSprite2Pixels`.
+ *
+ * CLX lines are stored bottom to top, so the lines below the drawn ones must be stepped over.
+ * If the sprite has a row-skip table (see `ClxEncodeOptions::rowSkipInterval`), this starts
+ * from the nearest table entry instead of the bottom line.
+ *
+ * @param firstLine The first line to draw, counting from the top.
+ * @param numLines The number of lines to draw. Clamped to the height of the sprite.
+ * @param pixels The first pixel of line `firstLine` in the output.
+ */
+void ClxSpriteLines2Pixels(std::span<const uint8_t> clxSprite, unsigned firstLine, unsigned numLines,
+    uint8_t *pixels, unsigned pitch);
+
+/**
+ * @brief An 8-bit color-indexed pixel buffer to draw on.
+ */
+struct ClxSurface {
+	uint8_t *pixels;
+	unsigned width;
+	unsigned height;
+	// The width of the line in the pixel buffer including padding.
+	unsigned pitch;
+};
+
+/**
+ * @brief A rectangle on a `ClxSurface`.
+ */
+struct ClxRect {
+	int64_t x;
+	int64_t y;
+	unsigned width;
+	unsigned height;
+};
+
+/**
+ * @brief Draws the opaque pixels of a single CLX sprite on a surface, clipped to a rectangle.
+ *
+ * Writes only within both `clip` and the surface. Clipped pixels are skipped within
+ * the commands that contain them. Drawing starts at the bottom visible line, using the
+ * row-skip table to get there if the sprite has one, and stops at the top visible line.
+ * Like `ClxSprite2Pixels`, the part of an opaque command that runs past the end of its
+ * line is not drawn.
+ *
+ * @param x The position of the left edge of the sprite on the surface. May be negative.
+ * @param y The position of the top edge of the sprite on the surface. May be negative.
+ * @param clip The rectangle to draw within. If `std::nullopt`, the whole surface.
+ */
+void DrawClxSprite(std::span<const uint8_t> clxSprite, const ClxSurface &surface, int64_t x, int64_t y,
+    std::optional<ClxRect> clip = std::nullopt);
+
 /**
  * @brief Converts a CLX to an 8-bit color-indexed pixel buffer.
  *
- * Does not clear the buffer before drawing.
+ * Writes every pixel of the output once: transparent pixels and the padding
+ * around the frames are set to `transparentColor`.
  *
  * @param clxData The CLX buffer.
  * @param transparentColor Palette index of the transparent color.
@@ -34,13 +100,15 @@ Size MeasureHorizontallyStackedClxListOrSheetSize(std::span<const uint8_t> clxDa
  * @param pitch The width of the line in the pixel buffer including padding.
  *     If `std::nullopt`, assumes no padding.
  * @param outDimensions If non-null, set to the dimensions of the resulting image.
+ * @param options Decoding options, e.g. the number of threads to draw sprites on or a downscaling factor.
  */
 std::optional<IoError> Clx2Pixels(
     std::span<const uint8_t> clxData,
     uint8_t transparentColor,
     std::vector<uint8_t> &pixels,
     std::optional<unsigned> pitch = std::nullopt,
-    Size *outDimensions = nullptr);
+    Size *outDimensions = nullptr,
+    const ClxDecodeOptions &options = {});
 
 /**
  * @brief Converts a CLX to an 8-bit color-indexed pixel buffer.
@@ -52,13 +120,178 @@ std::optional<IoError> Clx2Pixels(
  *     The frames are stacked vertically.
  * @param pitch The width of the line in the pixel buffer including padding.
  * @param outDimensions If non-null, set to the dimensions of the resulting image.
+ * @param options Decoding options, e.g. the number of threads to draw sprites on or a downscaling factor.
  */
 std::optional<IoError> Clx2Pixels(
     std::span<const uint8_t> clxData,
     uint8_t transparentColor,
     uint8_t *pixels,
     unsigned pitch,
-    Size *outDimensions = nullptr);
+    Size *outDimensions = nullptr,
+    const ClxDecodeOptions &options = {});
+
+/**
+ * @brief A band of lines of the image drawn by `Clx2PixelBands`.
+ */
+struct ClxPixelBand {
+	// The dimensions of the whole image.
+	Size imageSize;
+	// The index of the first line of the band in the image.
+	unsigned firstLine;
+	unsigned numLines;
+	// The `numLines * imageSize.width` pixels of the band, without padding.
+	std::span<const uint8_t> pixels;
+};
+
+/**
+ * @brief Converts a CLX to the same image as `Clx2Pixels`, a band of lines at a time.
+ *
+ * Only the sprites that intersect a band are drawn for it, so memory use is bounded by
+ * the band size rather than the image size. With `ClxDecodeOptions::numThreads`, up to
+ * one band per thread is drawn at a time. Each band is filled with the transparent color
+ * and the opaque pixels are drawn over it. With `ClxDecodeOptions::validatedSprites`,
+ * the sprites that allow it are drawn without any bounds checks.
+ *
+ * @param clxData The CLX buffer.
+ * @param transparentColor Palette index of the transparent color.
+ * @param bandHeight The number of lines per band. The last band may have fewer.
+ *     If 0, the height of the tallest sprite, so that memory use is bounded by the largest sprite
+ *     and every sprite is drawn in at most two bands.
+ * @param consumer Called with every band, top to bottom, or once with no lines if the image
+ *     is empty. The pixels are only valid during the call. If it returns an error,
+ *     no more bands are drawn and the error is returned.
+ * @param options Decoding options, e.g. the number of threads to draw bands on or a downscaling factor.
+ */
+std::optional<IoError> Clx2PixelBands(
+    std::span<const uint8_t> clxData,
+    uint8_t transparentColor,
+    unsigned bandHeight,
+    const std::function<std::optional<IoError>(const ClxPixelBand &band)> &consumer,
+    const ClxDecodeOptions &options = {});
+
+/**
+ * @brief The rectangle of a frame in the image drawn by `Clx2PixelsPacked`.
+ */
+struct ClxFrameRect {
+	// The index of the list in the CLX sheet, 0 for a CLX list.
+	uint32_t list;
+	// The index of the frame in its list.
+	uint32_t frame;
+	uint32_t x;
+	uint32_t y;
+	uint32_t width;
+	uint32_t height;
+};
+
+/**
+ * @brief Converts a CLX to an 8-bit color-indexed atlas, with the frames packed
+ * into a compact rectangle rather than stacked.
+ *
+ * The frames are packed with a skyline packer, tallest first. Unlike `Clx2Pixels`,
+ * the part of an opaque command that runs past the end of its line is not drawn,
+ * as it would draw over the neighbouring frames.
+ *
+ * @param clxData The CLX buffer.
+ * @param transparentColor Palette index of the transparent color.
+ * @param pixels Output pixel buffer, without padding.
+ * @param frameRects Set to the rectangle of every frame, in the order of the frames in the CLX.
+ *     Empty frames have empty rectangles at (0, 0).
+ * @param outDimensions If non-null, set to the dimensions of the resulting image.
+ * @param options Decoding options, e.g. the number of threads to draw sprites on or a downscaling factor.
+ *     With a downscaling factor, the frames are packed at their downscaled sizes.
+ * @param atlasWidth The width to pack the frames into. Must be at least the width of the widest frame.
+ *     If `std::nullopt`, picks a width that makes the atlas roughly square.
+ */
+std::optional<IoError> Clx2PixelsPacked(
+    std::span<const uint8_t> clxData,
+    uint8_t transparentColor,
+    std::vector<uint8_t> &pixels,
+    std::vector<ClxFrameRect> &frameRects,
+    Size *outDimensions = nullptr,
+    const ClxDecodeOptions &options = {},
+    std::optional<unsigned> atlasWidth = std::nullopt);
+
+/**
+ * @brief Writes a 1-bit-per-pixel opacity mask of a single CLX sprite without decoding its pixels.
+ *
+ * Bit `x % 64` of word `x / 64` of a line is set if pixel `x` of the line is opaque.
+ * All `(width + 63) / 64` words of each line are written. Like `ClxSprite2Pixels`, the part
+ * of an opaque command that runs past the end of its line is not included.
+ *
+ * @param mask The first word of the top line.
+ * @param maskPitch The number of words per line in the mask buffer including padding.
+ */
+void ClxSpriteOpacityMask(std::span<const uint8_t> clxSprite, uint64_t *mask, size_t maskPitch);
+
+/**
+ * @brief A run of opaque pixels in a line, `[begin, end)`.
+ */
+struct ClxOpaqueSpan {
+	uint16_t begin;
+	uint16_t end;
+};
+
+/**
+ * @brief Lists the runs of opaque pixels of every line of a single CLX sprite, top line first,
+ * without decoding its pixels.
+ *
+ * Adjacent opaque commands are merged into a single span, so the spans of a line are
+ * separated by transparent pixels. Like `ClxSprite2Pixels`, the part of an opaque command
+ * that runs past the end of its line is not included.
+ *
+ * @param spans Set to the spans of all the lines.
+ * @param lineSpans Set to `height + 1` entries: the spans of line `y` are `[lineSpans[y], lineSpans[y + 1])`.
+ */
+void ClxSpriteOpaqueSpans(std::span<const uint8_t> clxSprite,
+    std::vector<ClxOpaqueSpan> &spans, std::vector<uint32_t> &lineSpans);
+
+/**
+ * @brief Converts a CLX to a 1-bit-per-pixel opacity mask of the image that `Clx2Pixels` draws.
+ *
+ * See `ClxSpriteOpacityMask` for the layout of the mask. Transparent pixels and the padding
+ * around the frames are 0. Costs a fraction of a full decode, as no pixel bytes are read.
+ *
+ * @param mask Output mask buffer.
+ * @param maskPitch The number of words per line in the mask buffer including padding.
+ *     If `std::nullopt`, assumes no padding.
+ * @return The dimensions of the image in pixels.
+ */
+Size Clx2OpacityMask(std::span<const uint8_t> clxData, std::vector<uint64_t> &mask,
+    std::optional<size_t> maskPitch = std::nullopt);
+
+/**
+ * @brief The order of the color channels of a 32-bit pixel in memory.
+ */
+enum class ClxRgbaFormat : uint8_t {
+	Rgba,
+	Bgra,
+};
+
+/**
+ * @brief Converts a CLX to a 32-bit color pixel buffer, looking up the palette while drawing.
+ *
+ * The output is the same image as `Clx2Pixels` with the palette applied, except that
+ * transparent pixels and the padding around the frames are all zeroes, i.e. transparent
+ * black. Opaque pixels have an alpha of 255.
+ *
+ * @param clxData The CLX buffer.
+ * @param palette 256 RGB colors, 768 bytes.
+ * @param format The order of the 4 bytes of each pixel in memory.
+ * @param pixels Output pixel buffer.
+ *     Individual frames are stacked vertically.
+ * @param pitch The width of the line in the pixel buffer including padding, in pixels.
+ *     If `std::nullopt`, assumes no padding.
+ * @param outDimensions If non-null, set to the dimensions of the resulting image.
+ * @param options Decoding options, e.g. the number of threads to draw sprites on or a downscaling factor.
+ */
+std::optional<IoError> Clx2Rgba(
+    std::span<const uint8_t> clxData,
+    std::span<const uint8_t> palette,
+    ClxRgbaFormat format,
+    std::vector<uint32_t> &pixels,
+    std::optional<unsigned> pitch = std::nullopt,
+    Size *outDimensions = nullptr,
+    const ClxDecodeOptions &options = {});
 
 } // namespace dvl_gfx
 
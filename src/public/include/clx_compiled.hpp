@@ -0,0 +1,82 @@
+#ifndef DVL_GFX_CLX_COMPILED_H_
+#define DVL_GFX_CLX_COMPILED_H_
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <clx2pixels.hpp>
+#include <dvl_gfx_common.hpp> // IWYU pragma: export
+
+namespace dvl_gfx {
+
+enum class ClxSpanKind : uint8_t {
+	// A run of a single color.
+	Fill,
+	// A run of pixels from the pixel pool.
+	Pixels,
+};
+
+/**
+ * @brief A CLX sprite pre-parsed for drawing many times, see `CompileClxSprite`.
+ *
+ * The opaque runs of each line are stored as spans in structure-of-arrays form,
+ * so drawing never parses control bytes. Lines are stored top to bottom.
+ */
+struct CompiledClxSprite {
+	uint16_t width = 0;
+	uint16_t height = 0;
+
+	/**
+	 * @brief The spans of line `y` are `[lineSpans[y], lineSpans[y + 1])`. `height + 1` entries.
+	 */
+	std::vector<uint32_t> lineSpans;
+
+	// The position of the span within its line.
+	std::vector<uint16_t> spanX;
+	std::vector<uint16_t> spanLength;
+	std::vector<ClxSpanKind> spanKind;
+	// The color of a `ClxSpanKind::Fill` span, or the index of the first pixel
+	// of a `ClxSpanKind::Pixels` span in `pixels`.
+	std::vector<uint32_t> spanData;
+
+	/**
+	 * @brief The pixels of all the `ClxSpanKind::Pixels` spans.
+	 */
+	std::vector<uint8_t> pixels;
+};
+
+/**
+ * @brief Converts a single CLX sprite, such as one returned by `GetSpriteDataFromClxList`,
+ * to a `CompiledClxSprite`.
+ *
+ * Adjacent opaque commands of a line are merged into a single span where possible.
+ * Like `ClxSprite2Pixels`, the part of an opaque command that runs past the end of
+ * its line is dropped.
+ */
+CompiledClxSprite CompileClxSprite(std::span<const uint8_t> clxSprite);
+
+/**
+ * @brief Draws the opaque pixels of a compiled sprite. Same output as `ClxSprite2Pixels`.
+ *
+ * @param pixels The top-left pixel of the output.
+ * @param pitch The width of the line in the pixel buffer including padding.
+ */
+void CompiledClxSprite2Pixels(const CompiledClxSprite &sprite, uint8_t *pixels, unsigned pitch);
+
+/**
+ * @brief Draws the opaque pixels of a compiled sprite on a surface, clipped to a rectangle.
+ * Same output as `DrawClxSprite`.
+ *
+ * Lines outside of the clip rectangle are not visited at all.
+ *
+ * @param x The position of the left edge of the sprite on the surface. May be negative.
+ * @param y The position of the top edge of the sprite on the surface. May be negative.
+ * @param clip The rectangle to draw within. If `std::nullopt`, the whole surface.
+ */
+void DrawCompiledClxSprite(const CompiledClxSprite &sprite, const ClxSurface &surface, int64_t x, int64_t y,
+    std::optional<ClxRect> clip = std::nullopt);
+
+} // namespace dvl_gfx
+#endif // DVL_GFX_CLX_COMPILED_H_
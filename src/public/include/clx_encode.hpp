@@ -1,10 +1,13 @@
 #ifndef DVL_GFX_CLX_ENCODE_H_
 #define DVL_GFX_CLX_ENCODE_H_
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <vector>
 
+#include <dvl_gfx_common.hpp>
 #include <dvl_gfx_endian.hpp>
 
 namespace dvl_gfx {
@@ -25,6 +28,236 @@ inline void ClxSheetHeaderSetListOffset(size_t listIndex, uint32_t offset, uint8
 	WriteLE32(&clxSheetHeader[listIndex * 4], offset);
 }
 
+/**
+ * @return The maximum number of bytes `AppendClxTransparentRun` writes for the given width.
+ */
+constexpr size_t ClxTransparentRunMaxSize(unsigned width)
+{
+	return (static_cast<size_t>(width) + 0x7E) / 0x7F;
+}
+
+/**
+ * @return The maximum number of bytes `AppendClxPixelsOrFillRun` writes for the given length.
+ *
+ * A pixels command costs 1 byte per 0x41 pixels on top of the pixels themselves,
+ * and every fill run in the middle of a span saves at least the byte of the pixels command that follows it.
+ */
+constexpr size_t ClxPixelsOrFillRunMaxSize(unsigned length)
+{
+	return static_cast<size_t>(length) + length / 0x41 + 1;
+}
+
+/**
+ * @brief An output cursor for CLX data that appends to a vector.
+ *
+ * Writers reserve the worst-case size of a run or a row once and then
+ * write control bytes and pixels without any further capacity checks.
+ *
+ * While the writer is alive, the vector may be larger than the written data.
+ * The vector is trimmed to the written size when the writer is destroyed.
+ */
+class ClxWriter {
+public:
+	explicit ClxWriter(std::vector<uint8_t> &out)
+	    : out_(out)
+	    , begin_(out.data())
+	    , cur_(out.data() + out.size())
+	    , end_(cur_)
+	{
+	}
+
+	ClxWriter(const ClxWriter &) = delete;
+	ClxWriter &operator=(const ClxWriter &) = delete;
+
+	~ClxWriter()
+	{
+		out_.resize(size());
+	}
+
+	/**
+	 * @return The number of bytes in the output, including the bytes that were there before the writer was created.
+	 */
+	[[nodiscard]] size_t size() const
+	{
+		return static_cast<size_t>(cur_ - begin_);
+	}
+
+	/**
+	 * @brief Ensures that at least `n` more bytes can be written.
+	 */
+	void reserve(size_t n)
+	{
+		if (static_cast<size_t>(end_ - cur_) < n)
+			grow(n);
+	}
+
+	/**
+	 * @brief Appends `n` zero bytes, e.g. for a header that is filled in later.
+	 *
+	 * @return The position of the first appended byte.
+	 */
+	size_t appendZeros(size_t n)
+	{
+		reserve(n);
+		const size_t pos = size();
+		std::memset(cur_, 0, n);
+		cur_ += n;
+		return pos;
+	}
+
+	/**
+	 * @brief Writes a single byte. The space must have been reserved.
+	 */
+	void writeByte(uint8_t value)
+	{
+		*cur_++ = value;
+	}
+
+	/**
+	 * @brief Writes `n` bytes. The space must have been reserved.
+	 */
+	void writeBytes(const uint8_t *src, size_t n)
+	{
+		std::memcpy(cur_, src, n);
+		cur_ += n;
+	}
+
+	/**
+	 * @return The output. Invalidated by `reserve` and the functions that call it.
+	 */
+	[[nodiscard]] uint8_t *data()
+	{
+		return begin_;
+	}
+
+	void writeLE16At(size_t pos, uint16_t value)
+	{
+		WriteLE16(begin_ + pos, value);
+	}
+
+	void writeLE32At(size_t pos, uint32_t value)
+	{
+		WriteLE32(begin_ + pos, value);
+	}
+
+private:
+	void grow(size_t n)
+	{
+		const size_t pos = size();
+		size_t newSize = pos + n;
+		if (newSize > out_.capacity())
+			newSize = std::max(newSize, 2 * out_.capacity());
+		out_.resize(newSize);
+		begin_ = out_.data();
+		cur_ = begin_ + pos;
+		end_ = begin_ + out_.size();
+	}
+
+	std::vector<uint8_t> &out_;
+	uint8_t *begin_;
+	uint8_t *cur_;
+	uint8_t *end_;
+};
+
+/**
+ * @brief A stand-in for `ClxWriter` that only counts the bytes that would be written.
+ *
+ * Running an encoder with a `ClxSizeCounter` instead of a `ClxWriter` measures
+ * the exact size of its output without writing anything.
+ */
+class ClxSizeCounter {
+public:
+	[[nodiscard]] size_t size() const
+	{
+		return size_;
+	}
+
+	void reserve(size_t /*n*/)
+	{
+	}
+
+	size_t appendZeros(size_t n)
+	{
+		const size_t pos = size_;
+		size_ += n;
+		return pos;
+	}
+
+	void writeByte(uint8_t /*value*/)
+	{
+		++size_;
+	}
+
+	void writeBytes(const uint8_t * /*src*/, size_t n)
+	{
+		size_ += n;
+	}
+
+	void writeLE16At(size_t /*pos*/, uint16_t /*value*/)
+	{
+	}
+
+	void writeLE32At(size_t /*pos*/, uint32_t /*value*/)
+	{
+	}
+
+private:
+	size_t size_ = 0;
+};
+
+void AppendClxTransparentRun(unsigned width, ClxWriter &out);
+void AppendClxTransparentRun(unsigned width, ClxSizeCounter &out);
+
+/**
+ * @return The row-skip interval to use for a frame of the given height, or 0 if the frame gets a standard header.
+ *
+ * This is `ClxEncodeOptions::rowSkipInterval`, widened if needed for the header size to fit in 16 bits.
+ */
+inline uint16_t GetClxRowSkipInterval(unsigned frameHeight, const ClxEncodeOptions &options)
+{
+	if (options.rowSkipInterval == 0 || frameHeight <= options.rowSkipInterval)
+		return 0;
+	constexpr unsigned MaxEntries = (UINT16_MAX - ClxExtendedFrameHeaderSize) / ClxRowSkipEntrySize;
+	return static_cast<uint16_t>(std::max(options.rowSkipInterval, (frameHeight - 1 + MaxEntries - 1) / MaxEntries));
+}
+
+/**
+ * @brief Extends the standard header of a complete frame with a row-skip table
+ * if `options` ask for one (see `ClxEncodeOptions::rowSkipInterval`).
+ *
+ * The frame begins at `frameHeaderPos` and ends at the end of `out`.
+ */
+void InsertClxRowSkipTable(size_t frameHeaderPos, unsigned frameHeight, const ClxEncodeOptions &options, ClxWriter &out);
+void InsertClxRowSkipTable(size_t frameHeaderPos, unsigned frameHeight, const ClxEncodeOptions &options, ClxSizeCounter &out);
+
+/**
+ * @brief Appends a span of opaque pixels, choosing between fill and pixels commands greedily.
+ */
+void AppendClxPixelsOrFillRun(const uint8_t *src, unsigned length, ClxWriter &out);
+void AppendClxPixelsOrFillRun(const uint8_t *src, unsigned length, ClxSizeCounter &out);
+
+/**
+ * @brief Appends a span of opaque pixels using the fewest possible bytes.
+ *
+ * Runs a shortest-path search over the span, where each pixels command costs 1 byte plus
+ * its pixels and each fill command costs 2 bytes.
+ */
+void AppendClxPixelsOrFillRunOptimal(const uint8_t *src, unsigned length, ClxWriter &out);
+void AppendClxPixelsOrFillRunOptimal(const uint8_t *src, unsigned length, ClxSizeCounter &out);
+
+/**
+ * @brief Appends a span of opaque pixels using the encoder selected by `options`.
+ */
+template <typename Out>
+void AppendClxPixelsOrFillRun(const uint8_t *src, unsigned length, Out &out, const ClxEncodeOptions &options)
+{
+	if (options.optimize) {
+		AppendClxPixelsOrFillRunOptimal(src, length, out);
+	} else {
+		AppendClxPixelsOrFillRun(src, length, out);
+	}
+}
+
 void AppendClxTransparentRun(unsigned width, std::vector<uint8_t> &out);
 void AppendClxPixelsOrFillRun(const uint8_t *src, unsigned length, std::vector<uint8_t> &out);
 
@@ -0,0 +1,62 @@
+#ifndef DVL_GFX_CLX_INFO_H_
+#define DVL_GFX_CLX_INFO_H_
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <dvl_gfx_common.hpp> // IWYU pragma: export
+
+namespace dvl_gfx {
+
+/**
+ * @brief The metadata of a CLX sprite (frame), from its frame header.
+ */
+struct ClxFrameInfo {
+	uint16_t width;
+	uint16_t height;
+	// The size of the frame header, larger than `ClxFrameHeaderSize` if it has a row-skip table.
+	uint16_t headerSize;
+	// The size of the frame in bytes, including its header.
+	uint32_t size;
+};
+
+/**
+ * @brief The metadata of a CLX list.
+ */
+struct ClxListInfo {
+	// The offset of the list in the file.
+	uint32_t offset;
+	// The size of the list in bytes, including its frame offset table.
+	uint32_t size;
+	std::vector<ClxFrameInfo> frames;
+
+	/**
+	 * @brief The dimensions of the list if its frames were stacked vertically,
+	 * like `MeasureVerticallyStackedClxListSize`.
+	 */
+	[[nodiscard]] Size verticallyStackedSize() const;
+};
+
+/**
+ * @brief The metadata of a CLX list or sheet. A single CLX list is a sheet with one list.
+ */
+struct ClxInfo {
+	uint64_t fileSize = 0;
+	bool isSheet = false;
+	std::vector<ClxListInfo> lists;
+};
+
+/**
+ * @brief Reads the metadata of the CLX list or sheet at `path` without reading its pixel data.
+ *
+ * Only the list and frame offset tables and the frame headers are read, with positioned reads
+ * rather than by loading or mapping the whole file, so the I/O is proportional to the size of
+ * the headers. The offset tables are validated like `ClxView::open` does.
+ *
+ * @param info Set to the metadata.
+ */
+std::optional<IoError> ReadClxInfo(const char *path, ClxInfo &info);
+
+} // namespace dvl_gfx
+#endif // DVL_GFX_CLX_INFO_H_
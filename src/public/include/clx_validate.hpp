@@ -0,0 +1,36 @@
+#ifndef DVL_GFX_CLX_VALIDATE_H_
+#define DVL_GFX_CLX_VALIDATE_H_
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <dvl_gfx_common.hpp> // IWYU pragma: export
+
+namespace dvl_gfx {
+
+/**
+ * @brief Checks that a CLX list or sheet is well-formed, in a single pass over the data.
+ *
+ * Checks the list and frame offset tables, the frame headers, including any row-skip
+ * table, and the command streams: every command must lie within its frame, and the
+ * commands must end at the end of a line and not cover more than `width * height` pixels.
+ *
+ * The decoders in this library do not check bounds, so untrusted data must pass
+ * this check before it is decoded.
+ *
+ * @param outSprites If non-null, set to the properties of every sprite, in order.
+ *     Can be passed to the decoders as `ClxDecodeOptions::validatedSprites`.
+ */
+std::optional<IoError> ValidateClx(std::span<const uint8_t> clxData,
+    std::vector<ClxSpriteProperties> *outSprites = nullptr);
+
+/**
+ * @brief Checks a single CLX sprite, including its frame header, like `ValidateClx`.
+ */
+std::optional<IoError> ValidateClxSprite(std::span<const uint8_t> clxSprite,
+    ClxSpriteProperties *outProperties = nullptr);
+
+} // namespace dvl_gfx
+#endif // DVL_GFX_CLX_VALIDATE_H_
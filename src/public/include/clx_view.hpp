@@ -0,0 +1,160 @@
+#ifndef DVL_GFX_CLX_VIEW_H_
+#define DVL_GFX_CLX_VIEW_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <clx_decode.hpp>
+#include <dvl_gfx_common.hpp> // IWYU pragma: export
+
+namespace dvl_gfx {
+
+/**
+ * @brief A single CLX sprite (frame), including its frame header.
+ */
+class ClxSpriteView {
+public:
+	explicit ClxSpriteView(std::span<const uint8_t> data)
+	    : data_(data)
+	{
+	}
+
+	[[nodiscard]] uint16_t width() const
+	{
+		return GetClxSpriteWidth(data_.data());
+	}
+
+	[[nodiscard]] uint16_t height() const
+	{
+		return GetClxSpriteHeight(data_.data());
+	}
+
+	[[nodiscard]] std::span<const uint8_t> data() const
+	{
+		return data_;
+	}
+
+private:
+	std::span<const uint8_t> data_;
+};
+
+/**
+ * @brief A CLX list, i.e. a frame offset table followed by the frames.
+ */
+class ClxListView {
+public:
+	explicit ClxListView(std::span<const uint8_t> data)
+	    : data_(data)
+	{
+	}
+
+	[[nodiscard]] uint32_t numSprites() const
+	{
+		return GetNumSpritesFromClxList(data_.data());
+	}
+
+	/**
+	 * @brief Looks up a sprite in the frame offset table. O(1).
+	 *
+	 * @param spriteIndex Must be less than `numSprites()`.
+	 */
+	[[nodiscard]] ClxSpriteView sprite(size_t spriteIndex) const
+	{
+		return ClxSpriteView { GetSpriteDataFromClxList(data_.data(), spriteIndex) };
+	}
+
+	[[nodiscard]] std::span<const uint8_t> data() const
+	{
+		return data_;
+	}
+
+private:
+	std::span<const uint8_t> data_;
+};
+
+/**
+ * @brief Random access to the sprites of a CLX list or sheet without loading the whole file.
+ *
+ * The file is memory-mapped, so only the pages of the sprites that are accessed are read.
+ * The offset tables are validated once, when the view is opened: every list and sprite
+ * lies within the data and has a complete header. The pixel data is not validated.
+ *
+ * A single CLX list is viewed as a sheet with one list.
+ */
+class ClxView {
+public:
+	ClxView() = default;
+	ClxView(ClxView &&other) noexcept;
+	ClxView &operator=(ClxView &&other) noexcept;
+	ClxView(const ClxView &) = delete;
+	ClxView &operator=(const ClxView &) = delete;
+	~ClxView();
+
+	/**
+	 * @brief Memory-maps the CLX list or sheet at `path` and validates its offset tables.
+	 */
+	std::optional<IoError> open(const char *path);
+
+	/**
+	 * @brief Views a CLX list or sheet that is already in memory and validates its offset tables.
+	 *
+	 * `clxData` must outlive the view.
+	 */
+	std::optional<IoError> open(std::span<const uint8_t> clxData);
+
+	/**
+	 * @brief Unmaps the file, if any, and resets the view to an empty one.
+	 */
+	void close();
+
+	/**
+	 * @brief Whether the data is a CLX sheet rather than a single CLX list.
+	 */
+	[[nodiscard]] bool isSheet() const
+	{
+		return isSheet_;
+	}
+
+	[[nodiscard]] size_t numLists() const
+	{
+		return lists_.size();
+	}
+
+	/**
+	 * @param listIndex Must be less than `numLists()`.
+	 */
+	[[nodiscard]] ClxListView list(size_t listIndex) const
+	{
+		return ClxListView { lists_[listIndex] };
+	}
+
+	[[nodiscard]] std::span<const uint8_t> data() const
+	{
+		return data_;
+	}
+
+	/**
+	 * @brief Draws the opaque pixels of a single sprite. Reads only the bytes of that sprite.
+	 *
+	 * See `ClxSprite2Pixels`.
+	 *
+	 * @param dst The top-left pixel of the output. Must fit `width x height` pixels of the sprite.
+	 * @param pitch The width of the line in the output buffer including padding.
+	 */
+	std::optional<IoError> decodeSprite(size_t listIndex, size_t spriteIndex, uint8_t *dst, unsigned pitch) const;
+
+private:
+	std::span<const uint8_t> data_;
+	std::vector<std::span<const uint8_t>> lists_;
+	bool isSheet_ = false;
+
+	// The memory mapping, if the view was opened from a file.
+	void *mapping_ = nullptr;
+	size_t mappingSize_ = 0;
+};
+
+} // namespace dvl_gfx
+#endif // DVL_GFX_CLX_VIEW_H_
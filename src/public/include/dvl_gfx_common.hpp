@@ -4,6 +4,7 @@
 #include <cstddef>
 #include <cstdint>
 
+#include <span>
 #include <string>
 
 namespace dvl_gfx {
@@ -28,5 +29,108 @@ struct Size {
  */
 constexpr size_t ClxFrameHeaderSize = 6;
 
+/**
+ * Extended CLX frame header with a row-skip table, written with `ClxEncodeOptions::rowSkipInterval`.
+ * Readers that only follow the header size field skip the rest of it.
+ *
+ *   Bytes   |   Type   | Value
+ * :--------:|:--------:|-------------
+ *  0..2     | uint16_t | header size: 8 + 5 * n
+ *  2..4     | uint16_t | width
+ *  4..6     | uint16_t | height
+ *  6..8     | uint16_t | row-skip interval N
+ *  8..8+4n  | uint32_t | n frame offsets
+ *  ..8+5n   | uint8_t  | n pixel counts
+ *
+ * There are `n = (height - 1) / N` entries, one for each line `k * N` for k in [1, n],
+ * counting lines from the bottom like the pixel data. Entry `k - 1` is the offset from
+ * the start of the frame of the command in which line `k * N` begins, and the number
+ * of pixels of that command that precede the line.
+ */
+constexpr size_t ClxExtendedFrameHeaderSize = 8;
+constexpr size_t ClxRowSkipEntrySize = 5;
+
+/**
+ * @brief Options for the CLX encoders.
+ */
+struct ClxEncodeOptions {
+	/**
+	 * @brief Find the smallest possible encoding of every opaque span instead of
+	 * using the fast greedy encoder. Slower.
+	 */
+	bool optimize = false;
+
+	/**
+	 * @brief The number of threads to encode frames on, 0 for one per hardware thread.
+	 *
+	 * The output does not depend on the number of threads.
+	 */
+	unsigned numThreads = 1;
+
+	/**
+	 * @brief If non-zero, write an extended frame header with the position of every
+	 * `rowSkipInterval`-th line, so that decoders can start drawing at any line
+	 * without parsing the lines below it. See `ClxExtendedFrameHeaderSize`.
+	 *
+	 * Frames that are not taller than the interval get the standard header.
+	 */
+	unsigned rowSkipInterval = 0;
+};
+
+/**
+ * @brief Properties of a CLX sprite, found by `ValidateClx`.
+ */
+struct ClxSpriteProperties {
+	/**
+	 * @brief No opaque command runs past the end of its line.
+	 */
+	bool opaqueCommandsWithinLines = false;
+
+	/**
+	 * @brief No command at all, opaque or transparent, runs past the end of its line.
+	 */
+	bool commandsWithinLines = false;
+
+	/**
+	 * @brief The commands cover all `width * height` pixels rather than ending early.
+	 */
+	bool coversAllPixels = false;
+
+	/**
+	 * @brief The sprite has a row-skip table (see `ClxEncodeOptions::rowSkipInterval`).
+	 */
+	bool hasRowSkipTable = false;
+};
+
+/**
+ * @brief Options for the CLX decoders.
+ */
+struct ClxDecodeOptions {
+	/**
+	 * @brief The number of threads to draw sprites on, 0 for one per hardware thread.
+	 *
+	 * The output does not depend on the number of threads.
+	 */
+	unsigned numThreads = 1;
+
+	/**
+	 * @brief Draw the sprites at 1/`scale` of their size: 1, 2, 4 or 8.
+	 *
+	 * Each output pixel is the top-left pixel of its `scale x scale` block of the sprite,
+	 * sampled directly from the CLX commands. Each sprite is `ceil(width / scale)` by
+	 * `ceil(height / scale)` pixels.
+	 */
+	unsigned scale = 1;
+
+	/**
+	 * @brief The properties of every sprite, in order, as found by `ValidateClx` for the same data.
+	 *
+	 * `Clx2Pixels` and `Clx2PixelBands` draw the sprites whose opaque commands lie within their lines and whose
+	 * commands cover the whole sprite with a kernel that does no bounds checks.
+	 * Ignored if empty.
+	 */
+	std::span<const ClxSpriteProperties> validatedSprites;
+};
+
 } // namespace dvl_gfx
 #endif // DVL_GFX_COMMON_H_
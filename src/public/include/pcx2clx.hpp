@@ -1,6 +1,7 @@
 #ifndef DVL_GFX_PCX2CLX_H_
 #define DVL_GFX_PCX2CLX_H_
 
+#include <cstddef>
 #include <cstdint>
 #include <optional>
 #include <string>
@@ -10,6 +11,21 @@
 
 namespace dvl_gfx {
 
+/**
+ * @brief Measures the exact size of the CLX data that `PcxToClx` would produce for the same arguments.
+ *
+ * Runs the encoder without writing anything, e.g. to pre-size an output file.
+ *
+ * @param clxSize Output CLX size.
+ * @return std::optional<IoError>
+ */
+std::optional<IoError> MeasurePcxToClxSize(const uint8_t *data, size_t size,
+    int numFramesOrFrameHeight,
+    std::optional<uint8_t> transparentColor,
+    const std::vector<uint16_t> &cropWidths,
+    size_t &clxSize,
+    const ClxEncodeOptions &options = {});
+
 /**
  * @brief Converts a PCX image to CLX.
  *
@@ -19,6 +35,7 @@ namespace dvl_gfx {
  * @param transparentColor Palette index of the transparent color.
  * @param cropWidths If non-empty, the sprites are cropped to the given width(s) by removing the right side of the sprite.
  * @param paletteData If non-null, PCX palette data (256 * 3 bytes).
+ * @param options Encoder options.
  * @return std::optional<IoError>
  */
 std::optional<IoError> PcxToClx(const uint8_t *data, size_t size,
@@ -26,7 +43,8 @@ std::optional<IoError> PcxToClx(const uint8_t *data, size_t size,
     std::optional<uint8_t> transparentColor,
     const std::vector<uint16_t> &cropWidths,
     std::vector<uint8_t> &clxData,
-    uint8_t *paletteData = nullptr);
+    uint8_t *paletteData = nullptr,
+    const ClxEncodeOptions &options = {});
 
 std::optional<IoError> PcxToClx(const char *inputPath, const char *outputPath,
     int numFramesOrFrameHeight = 1,
@@ -34,7 +52,8 @@ std::optional<IoError> PcxToClx(const char *inputPath, const char *outputPath,
     const std::vector<uint16_t> &cropWidths = {},
     bool exportPalette = false,
     uintmax_t *inputFileSize = nullptr,
-    uintmax_t *outputFileSize = nullptr);
+    uintmax_t *outputFileSize = nullptr,
+    const ClxEncodeOptions &options = {});
 
 } // namespace dvl_gfx
 #endif // DVL_GFX_PCX2CLX_H_
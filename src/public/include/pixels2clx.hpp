@@ -1,12 +1,28 @@
 #ifndef DVL_GFX_PIXELS2CLX_H_
 #define DVL_GFX_PIXELS2CLX_H_
 
+#include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <optional>
+#include <ostream>
+#include <span>
 #include <vector>
 
+#include <dvl_gfx_common.hpp> // IWYU pragma: export
+
 namespace dvl_gfx {
 
+/**
+ * @brief Returns the exact size of the CLX data that `Pixels2Clx` would produce for the same arguments.
+ *
+ * Runs the encoder without writing anything, e.g. to pre-size an output file.
+ */
+size_t MeasurePixels2ClxSize(
+    const uint8_t *pixels,
+    unsigned pitch, unsigned width, unsigned frameHeight, unsigned numFrames,
+    std::optional<uint8_t> transparentColor, const ClxEncodeOptions &options = {});
+
 /**
  * @brief Converts an 8-bit color-indexed pixel buffer to a CLX sprite (list).
  *
@@ -20,11 +36,108 @@ namespace dvl_gfx {
  * @param numFrames The number of frames in the pixel buffer.
  * @param transparentColor Palette index of the transparent color.
  * @param clxData Output CLX buffer.
+ * @param options Encoder options.
  */
 void Pixels2Clx(
     const uint8_t *pixels,
     unsigned pitch, unsigned width, unsigned frameHeight, unsigned numFrames,
-    std::optional<uint8_t> transparentColor, std::vector<uint8_t> &clxData);
+    std::optional<uint8_t> transparentColor, std::vector<uint8_t> &clxData,
+    const ClxEncodeOptions &options = {});
+
+/**
+ * @brief Receives the bytes produced by `ClxEncoder`.
+ *
+ * Offsets are relative to the position of the first byte written by the encoder.
+ */
+struct ClxEncoderSink {
+	/** @brief Appends `data` to the output. */
+	std::function<std::optional<IoError>(std::span<const uint8_t> data)> write;
+
+	/**
+	 * @brief Overwrites already written bytes at `offset` with `data`.
+	 *
+	 * Used to fill in the offset tables once the sizes of the frames are known.
+	 */
+	std::function<std::optional<IoError>(size_t offset, std::span<const uint8_t> data)> writeAt;
+};
+
+/**
+ * @brief A sink that appends to `out`. `out` must outlive the sink.
+ */
+ClxEncoderSink MakeClxVectorSink(std::vector<uint8_t> &out);
+
+/**
+ * @brief A sink that writes to a seekable stream, starting at its current position.
+ * `out` must outlive the sink.
+ */
+ClxEncoderSink MakeClxStreamSink(std::ostream &out);
+
+/**
+ * @brief Encodes CLX lists and sheets one frame at a time.
+ *
+ * Each frame is written to the sink as soon as it is encoded, so only a single
+ * encoded frame is held in memory at a time. The offset tables are written
+ * as placeholders and filled in by `endList` and `endSheet`.
+ *
+ * A list is encoded with:
+ *
+ *     beginList(numFrames); addFrame(...) * numFrames; endList();
+ *
+ * A sheet wraps one or more lists in `beginSheet(numLists)` / `endSheet()`.
+ */
+class ClxEncoder {
+public:
+	explicit ClxEncoder(ClxEncoderSink sink, const ClxEncodeOptions &options = {});
+
+	ClxEncoder(const ClxEncoder &) = delete;
+	ClxEncoder &operator=(const ClxEncoder &) = delete;
+
+	std::optional<IoError> beginSheet(uint32_t numLists);
+
+	std::optional<IoError> beginList(uint32_t numFrames);
+
+	/**
+	 * @brief Encodes a single frame.
+	 *
+	 * @param pixels The top row of the frame.
+	 * @param pitch Pixel buffer pitch, i.e. the width of each line including padding.
+	 * @param width Frame width.
+	 * @param height Frame height.
+	 * @param transparentColor Palette index of the transparent color.
+	 */
+	std::optional<IoError> addFrame(
+	    const uint8_t *pixels, unsigned pitch, unsigned width, unsigned height,
+	    std::optional<uint8_t> transparentColor);
+
+	std::optional<IoError> endList();
+
+	std::optional<IoError> endSheet();
+
+	/** @brief The number of bytes written so far. */
+	[[nodiscard]] size_t size() const
+	{
+		return size_;
+	}
+
+private:
+	std::optional<IoError> write(std::span<const uint8_t> data);
+
+	ClxEncoderSink sink_;
+	ClxEncodeOptions options_;
+	size_t size_ = 0;
+
+	bool inSheet_ = false;
+	size_t sheetBegin_ = 0;
+	uint32_t numLists_ = 0;
+	std::vector<uint32_t> listOffsets_;
+
+	bool inList_ = false;
+	size_t listBegin_ = 0;
+	uint32_t numFrames_ = 0;
+	std::vector<uint32_t> frameOffsets_;
+
+	std::vector<uint8_t> frameData_;
+};
 
 } // namespace dvl_gfx
 